@@ -0,0 +1,117 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	file_engine.h
+file path:	logfile
+file base:	file_engine
+file ext:	h
+author:
+
+purpose:	日志文件的写入引擎。log_file只通过file_engine接口写文件,
+			默认是fast_file(write(2)),linux下可以在运行时选择io_uring、
+			O_DIRECT或mmap,初始化失败时回退到fast_file。
+*********************************************************************/
+#ifndef __FILE_ENGINE_INCLUDE__
+#define __FILE_ENGINE_INCLUDE__
+
+#include <stddef.h>
+#include <string>
+#include <boost/utility.hpp>
+#ifndef WIN32
+#include <sys/uio.h>
+#endif
+
+namespace fst_log_file
+{
+
+	enum FileEngine
+	{
+		FILE_ENGINE_WRITE = 0 ,		//write(2)/stdio,同步写
+		FILE_ENGINE_URING ,			//io_uring异步写,只支持linux
+		FILE_ENGINE_DIRECT ,		//O_DIRECT,不经过页缓存,只支持linux
+		FILE_ENGINE_MMAP ,			//fallocate预分配后mmap,直接拷贝进映射区
+		FILE_ENGINE_LZ ,			//写入时按块压缩,文件名加.lz,用tools/lzcat查看
+	};
+
+	//数据落盘的方式,同步都在单独的线程里做,写文件的线程不会等设备
+	enum Durability
+	{
+		DURABILITY_NONE = 0 ,			//由内核自行回写
+		DURABILITY_PERIODIC ,			//每sync_interval_ms做一次fdatasync
+		DURABILITY_WRITE_BEHIND ,		//每写满write_behind_size用sync_file_range发起回写
+		DURABILITY_ON_ERROR ,			//写出含WARN/ERR的一批日志后fdatasync
+	};
+
+	struct file_options
+	{
+		file_options()
+			: engine(FILE_ENGINE_WRITE),
+			uring_depth(8),
+			uring_buffer_size(256 * 1024),
+			uring_fdatasync(false),
+			direct_buffer_size(1024 * 1024),
+			mmap_size(0),
+			durability(DURABILITY_NONE),
+			sync_interval_ms(1000),
+			write_behind_size(1024 * 1024),
+			precreate(false),
+			compress(false),
+			compress_threads(1)
+		{}
+
+		FileEngine engine ;
+		size_t uring_depth ;		//注册的暂存缓冲区个数,也是同时在途的写请求上限
+		size_t uring_buffer_size ;	//每个暂存缓冲区的字节数
+		bool uring_fdatasync ;		//flush时在已提交的写之后追加一个fdatasync
+		size_t direct_buffer_size ;	//O_DIRECT对齐暂存区的字节数,按块大小向上取整
+		size_t mmap_size ;			//每个文件预分配并映射的字节数,0表示使用log_file的rollSize
+		Durability durability ;
+		int sync_interval_ms ;		//同步线程最长的等待时间
+		size_t write_behind_size ;	//DURABILITY_WRITE_BEHIND下每次发起回写的字节数
+		bool precreate ;			//在后台预先创建并预分配下一个文件
+		bool compress ;				//滚动掉的文件在后台压缩成.lz
+		int compress_threads ;		//同时压缩的文件数
+	};
+
+	//posix下就是iovec,可以直接交给writev
+#ifdef WIN32
+	struct log_iovec
+	{
+		void* iov_base ;
+		size_t iov_len ;
+	};
+#else
+	typedef struct iovec log_iovec ;
+#endif
+
+	class file_engine : boost::noncopyable
+	{
+	public:
+		virtual ~file_engine() {}
+		virtual void append(const char* logline, const size_t len) = 0;
+		//一次写入多段,默认逐段append
+		virtual void append_batch(const log_iovec* vec, int count)
+		{
+			for (int i = 0; i < count; ++i)
+				append(static_cast<const char*>(vec[i].iov_base), vec[i].iov_len);
+		}
+		//把数据交给内核,异步引擎只保证提交,不等待完成
+		virtual void flush() = 0;
+		virtual size_t writtenBytes() const = 0;
+		//交给同步线程的文件描述符,没有时返回-1
+		virtual int native_fd() const { return -1; }
+		//预先分配磁盘空间但不改变文件长度,关闭时释放没用到的部分
+		virtual void preallocate(size_t /*bytes*/) {}
+	};
+
+	//按options创建引擎,所选引擎不可用时退回fast_file
+	file_engine* create_file_engine(const std::string& filename , const file_options& options);
+
+	//不支持或初始化失败时返回NULL
+	file_engine* create_uring_file(const std::string& filename , const file_options& options);
+	file_engine* create_direct_file(const std::string& filename , const file_options& options);
+	file_engine* create_mmap_file(const std::string& filename , const file_options& options);
+	file_engine* create_lz_file(const std::string& filename , const file_options& options);
+
+}
+
+#endif
@@ -0,0 +1,189 @@
+#include "stdafx.h"
+#include "file_engine.h"
+
+#if defined(__linux__) && !defined(FILELOGGER_NO_DIRECT_IO)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+namespace fst_log_file
+{
+
+//O_DIRECT要求缓冲区地址、文件偏移和长度都按块对齐
+static const size_t kDirectBlock = 4096 ;
+
+static size_t round_up_block(size_t n)
+{
+	return (n + kDirectBlock - 1) & ~(kDirectBlock - 1);
+}
+
+//日志先拷进对齐的暂存区,只按整块写出;不足一块的尾部补零写出后留在暂存区,
+//下次连同新数据重写这一块,关闭时把文件截断到实际长度
+class direct_file : public file_engine
+{
+public:
+	direct_file(const std::string& filename , const file_options& options);
+	~direct_file();
+
+	bool ok() const { return fd_ >= 0 && buf_ != NULL; }
+
+	void append(const char* logline, const size_t len);
+	void flush();
+	size_t writtenBytes() const { return writtenBytes_; }
+	int native_fd() const { return fd_; }
+	//关闭时本来就会截断到实际长度
+	void preallocate(size_t bytes)
+	{
+		if (fd_ >= 0)
+			::fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, bytes);
+	}
+
+private:
+	bool write_blocks(size_t len);
+
+	std::string filename_ ;
+	int fd_ ;
+	char* buf_ ;
+	size_t capacity_ ;
+	size_t len_ ;			//暂存区中的字节数
+	off_t offset_ ;			//buf_[0]在文件中的位置,总是块对齐的
+	size_t writtenBytes_ ;
+};
+
+direct_file::direct_file(const std::string& filename , const file_options& options)
+: filename_(filename),
+fd_(-1),
+buf_(NULL),
+capacity_(round_up_block(options.direct_buffer_size < kDirectBlock ? kDirectBlock : options.direct_buffer_size)),
+len_(0),
+offset_(0),
+writtenBytes_(0)
+{
+	void* p = NULL ;
+	if (::posix_memalign(&p, kDirectBlock, capacity_) != 0)
+		return ;
+	buf_ = static_cast<char*>(p);
+
+	//tmpfs等不支持O_DIRECT的文件系统在这里返回EINVAL
+	fd_ = ::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC | O_DIRECT, 0644);
+	if (fd_ < 0)
+		return ;
+
+	//续写已有文件时把最后一个不完整的块读回暂存区
+	struct stat st ;
+	if (::fstat(fd_, &st) == 0 && st.st_size > 0)
+	{
+		offset_ = st.st_size & ~static_cast<off_t>(kDirectBlock - 1);
+		len_ = static_cast<size_t>(st.st_size - offset_);
+		if (len_ > 0 && ::pread(fd_, buf_, kDirectBlock, offset_) < static_cast<ssize_t>(len_))
+		{
+			::close(fd_);
+			fd_ = -1 ;
+		}
+	}
+}
+
+direct_file::~direct_file()
+{
+	if (fd_ >= 0)
+	{
+		flush();
+		if (::ftruncate(fd_, offset_ + len_) != 0)
+			fprintf(stderr, "direct_file truncate %s failed %s\n", filename_.c_str(), strerror(errno));
+		::close(fd_);
+	}
+	::free(buf_);
+}
+
+bool direct_file::write_blocks(size_t len)
+{
+	size_t n = 0 ;
+	while (n < len)
+	{
+		ssize_t x = ::pwrite(fd_, buf_ + n, len - n, offset_ + n);
+		if (x < 0 && errno == EINTR)
+			continue ;
+		//短写只会停在块边界上,停在别处说明设备出错(例如磁盘满)
+		if (x <= 0 || (x & (kDirectBlock - 1)) != 0)
+		{
+			fprintf(stderr, "direct_file write %s failed %s\n", filename_.c_str(), strerror(x < 0 ? errno : EIO));
+			return false ;
+		}
+		n += x ;
+	}
+	return true ;
+}
+
+void direct_file::append(const char* logline, const size_t len)
+{
+	size_t n = 0 ;
+	while (n < len)
+	{
+		size_t x = len - n ;
+		if (x > capacity_ - len_)
+			x = capacity_ - len_ ;
+		memcpy(buf_ + len_, logline + n, x);
+		len_ += x ;
+		n += x ;
+		if (len_ == capacity_)
+		{
+			//写失败时丢掉这一段,文件中留下一个空洞
+			write_blocks(capacity_);
+			offset_ += capacity_ ;
+			len_ = 0 ;
+		}
+	}
+	writtenBytes_ += len ;
+}
+
+void direct_file::flush()
+{
+	if (len_ == 0)
+		return ;
+
+	size_t padded = round_up_block(len_);
+	memset(buf_ + len_, 0, padded - len_);
+	if (!write_blocks(padded))
+		return ;
+
+	//整块的部分不会再改,尾部挪到暂存区开头
+	size_t full = len_ & ~(kDirectBlock - 1);
+	if (full > 0)
+	{
+		memmove(buf_, buf_ + full, len_ - full);
+		offset_ += full ;
+		len_ -= full ;
+	}
+}
+
+file_engine* create_direct_file(const std::string& filename , const file_options& options)
+{
+	direct_file* file = new direct_file(filename, options);
+	if (!file->ok())
+	{
+		delete file ;
+		return NULL ;
+	}
+	return file ;
+}
+
+}
+
+#else
+
+namespace fst_log_file
+{
+
+file_engine* create_direct_file(const std::string& , const file_options&)
+{
+	return NULL ;
+}
+
+}
+
+#endif
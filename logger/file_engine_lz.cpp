@@ -0,0 +1,141 @@
+#include "stdafx.h"
+#include "log_file.h"
+#include "log_lz.h"
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fst_log_file
+{
+
+//写文件时直接压缩:记录先攒到staging_,攒满一块或flush时压成独立的块,经fast_file追加到文件,
+//关闭时写结尾标记。进程崩溃只会丢掉还没压缩的记录和最后一个写了一半的块,重新打开时截掉它
+//(连同结尾标记)再续写
+class lz_file : public file_engine
+{
+public:
+	explicit lz_file(const std::string& filename);
+	~lz_file();
+
+	bool ok() const { return sink_.get() != NULL; }
+
+	void append(const char* logline, const size_t len);
+	void append_batch(const log_iovec* vec, int count);
+	void flush();
+	//压缩后的字节数,按它滚动文件
+	size_t writtenBytes() const { return sink_->writtenBytes(); }
+	int native_fd() const { return sink_->native_fd(); }
+	void preallocate(size_t bytes) { sink_->preallocate(bytes); }
+
+private:
+	void write_block(const char* data , size_t len);
+	void flush_staging();
+
+	boost::scoped_ptr<file_engine> sink_ ;
+	std::vector<char> staging_ ;		//还没压缩的记录,攒满一块再压缩
+	std::vector<char> packed_ ;
+};
+
+static bool truncate_file(const std::string& filename , boost::uint64_t length)
+{
+#ifdef WIN32
+	int fd = ::_open(filename.c_str() , _O_WRONLY | _O_BINARY);
+	if (fd < 0)
+		return false ;
+	bool ok = ::_chsize_s(fd , length) == 0 ;
+	::_close(fd);
+	return ok ;
+#else
+	return ::truncate(filename.c_str() , static_cast<off_t>(length)) == 0 ;
+#endif
+}
+
+lz_file::lz_file(const std::string& filename)
+: packed_(lz::block_bound(lz::kFileBlockSize))
+{
+	boost::uint64_t valid = 0 ;
+	if (!lz::scan_file(filename , &valid))
+	{
+		fprintf(stderr, "lz_file %s exists and is not an lz log\n", filename.c_str());
+		return ;
+	}
+	//截掉崩溃时写了一半的块
+	if (valid > 0 && !truncate_file(filename , valid))
+		return ;
+
+	sink_.reset(new fast_file(filename));
+	if (valid == 0)
+		sink_->append("FLZ1" , 4);
+	staging_.reserve(lz::kFileBlockSize);
+}
+
+void lz_file::write_block(const char* data , size_t len)
+{
+	while (len > 0)
+	{
+		size_t n = len < lz::kFileBlockSize ? len : lz::kFileBlockSize ;
+		size_t packed = lz::encode_block(data , n , &packed_[0]);
+		sink_->append(&packed_[0] , packed);
+		data += n ;
+		len -= n ;
+	}
+}
+
+lz_file::~lz_file()
+{
+	if (sink_)
+	{
+		flush_staging();
+		const char trailer[4] = { 0 , 0 , 0 , 0 };
+		sink_->append(trailer , sizeof trailer);
+	}
+}
+
+void lz_file::flush_staging()
+{
+	if (!staging_.empty())
+	{
+		write_block(&staging_[0] , staging_.size());
+		staging_.clear();
+	}
+}
+
+void lz_file::flush()
+{
+	flush_staging();
+	sink_->flush();
+}
+
+void lz_file::append(const char* logline, const size_t len)
+{
+	if (staging_.size() + len > lz::kFileBlockSize)
+		flush_staging();
+	//单条超过一块的记录直接切块压缩
+	if (len >= lz::kFileBlockSize)
+		write_block(logline , len);
+	else
+		staging_.insert(staging_.end() , logline , logline + len);
+}
+
+void lz_file::append_batch(const log_iovec* vec, int count)
+{
+	for (int i = 0; i < count; ++i)
+		append(static_cast<const char*>(vec[i].iov_base) , vec[i].iov_len);
+	flush_staging();
+}
+
+file_engine* create_lz_file(const std::string& filename , const file_options&)
+{
+	lz_file* file = new lz_file(filename);
+	if (!file->ok())
+	{
+		delete file ;
+		return NULL ;
+	}
+	return file ;
+}
+
+}
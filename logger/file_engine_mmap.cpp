@@ -0,0 +1,194 @@
+#include "stdafx.h"
+#include "file_engine.h"
+
+#if !defined(WIN32) && !defined(FILELOGGER_NO_MMAP)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace fst_log_file
+{
+
+//文件先fallocate到预分配大小再整体映射,append只是memcpy,没有系统调用;
+//进程崩溃后内核仍会把映射区的脏页写回,关闭时截断到实际写入的长度
+class mmap_file : public file_engine
+{
+public:
+	mmap_file(const std::string& filename , const file_options& options);
+	~mmap_file();
+
+	bool ok() const { return map_ != NULL; }
+
+	void append(const char* logline, const size_t len);
+	void flush();
+	size_t writtenBytes() const { return writtenBytes_; }
+	int native_fd() const { return fd_; }
+
+private:
+	bool reserve(size_t size);
+	bool map(size_t size);
+
+	std::string filename_ ;
+	int fd_ ;
+	char* map_ ;
+	size_t mapped_ ;		//映射区大小,也是预分配后的文件大小
+	size_t used_ ;			//文件中有效数据的长度
+	size_t synced_ ;		//已经msync过的长度,按页对齐
+	size_t grow_ ;			//映射区不够时每次扩大的字节数
+	size_t page_ ;
+	size_t writtenBytes_ ;
+};
+
+mmap_file::mmap_file(const std::string& filename , const file_options& options)
+: filename_(filename),
+fd_(-1),
+map_(NULL),
+mapped_(0),
+used_(0),
+synced_(0),
+grow_(0),
+page_(static_cast<size_t>(::sysconf(_SC_PAGESIZE))),
+writtenBytes_(0)
+{
+	fd_ = ::open(filename.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (fd_ < 0)
+	{
+		fprintf(stderr, "mmap_file open %s failed %s\n", filename.c_str(), strerror(errno));
+		return ;
+	}
+
+	struct stat st ;
+	if (::fstat(fd_, &st) == 0)
+		used_ = static_cast<size_t>(st.st_size);
+	synced_ = used_ & ~(page_ - 1);
+
+	size_t size = options.mmap_size ? options.mmap_size : 4 * 1024 * 1024 ;
+	grow_ = (size + page_ - 1) & ~(page_ - 1);
+	if (!reserve(used_ + grow_) || !map(used_ + grow_))
+	{
+		::close(fd_);
+		fd_ = -1 ;
+	}
+}
+
+mmap_file::~mmap_file()
+{
+	if (map_)
+		::munmap(map_, mapped_);
+	if (fd_ >= 0)
+	{
+		//去掉预分配而没有用到的部分
+		if (::ftruncate(fd_, used_) != 0)
+			fprintf(stderr, "mmap_file truncate %s failed %s\n", filename_.c_str(), strerror(errno));
+		::close(fd_);
+	}
+}
+
+//先真正分配磁盘块,避免写映射区时因为磁盘满收到SIGBUS;
+//文件系统不支持fallocate时只能扩展成稀疏文件
+bool mmap_file::reserve(size_t size)
+{
+	size = (size + page_ - 1) & ~(page_ - 1);
+#ifdef __linux__
+	int err = ::fallocate(fd_, 0, 0, size) == 0 ? 0 : errno ;
+#else
+	int err = ::posix_fallocate(fd_, 0, size);
+#endif
+	if (err == 0)
+		return true ;
+	if (err == EOPNOTSUPP || err == ENOSYS || err == EINVAL)
+		return ::ftruncate(fd_, size) == 0 ;
+	fprintf(stderr, "mmap_file fallocate %s failed %s\n", filename_.c_str(), strerror(err));
+	return false ;
+}
+
+bool mmap_file::map(size_t size)
+{
+	size = (size + page_ - 1) & ~(page_ - 1);
+	void* p ;
+#ifdef __linux__
+	if (map_)
+		p = ::mremap(map_, mapped_, size, MREMAP_MAYMOVE);
+	else
+#endif
+	{
+		if (map_)
+			::munmap(map_, mapped_);
+		map_ = NULL ;
+		p = ::mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+	}
+	if (p == MAP_FAILED)
+	{
+		fprintf(stderr, "mmap_file map %s failed %s\n", filename_.c_str(), strerror(errno));
+		return false ;
+	}
+	map_ = static_cast<char*>(p);
+	mapped_ = size ;
+	return true ;
+}
+
+void mmap_file::append(const char* logline, const size_t len)
+{
+	//越过rollSize的最后一批数据可能超出预分配,扩大后重新映射
+	if (used_ + len > mapped_)
+	{
+		size_t size = mapped_ + grow_ ;
+		while (size < used_ + len)
+			size += grow_ ;
+		if (!reserve(size) || !map(size))
+		{
+			if (map_ == NULL)
+				return ;
+			//扩不了就只写下能放下的部分
+			size_t x = mapped_ - used_ ;
+			memcpy(map_ + used_, logline, x);
+			used_ += x ;
+			writtenBytes_ += len ;
+			return ;
+		}
+	}
+	memcpy(map_ + used_, logline, len);
+	used_ += len ;
+	writtenBytes_ += len ;
+}
+
+//MS_ASYNC只是安排写回,不等待
+void mmap_file::flush()
+{
+	if (map_ == NULL || used_ <= synced_)
+		return ;
+	::msync(map_ + synced_, used_ - synced_, MS_ASYNC);
+	synced_ = used_ & ~(page_ - 1);
+}
+
+file_engine* create_mmap_file(const std::string& filename , const file_options& options)
+{
+	mmap_file* file = new mmap_file(filename, options);
+	if (!file->ok())
+	{
+		delete file ;
+		return NULL ;
+	}
+	return file ;
+}
+
+}
+
+#else
+
+namespace fst_log_file
+{
+
+file_engine* create_mmap_file(const std::string& , const file_options&)
+{
+	return NULL ;
+}
+
+}
+
+#endif
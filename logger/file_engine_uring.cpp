@@ -0,0 +1,397 @@
+#include "stdafx.h"
+#include "file_engine.h"
+
+#if defined(__linux__) && !defined(FILELOGGER_NO_URING)
+#include <sys/syscall.h>
+#endif
+
+#if defined(__linux__) && !defined(FILELOGGER_NO_URING) && defined(__NR_io_uring_setup)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <vector>
+#include <boost/cstdint.hpp>
+
+namespace fst_log_file
+{
+
+//不依赖liburing,直接用系统调用操作提交队列和完成队列
+class uring_file : public file_engine
+{
+public:
+	uring_file(const std::string& filename , const file_options& options);
+	~uring_file();
+
+	bool ok() const { return ring_fd_ >= 0 && fd_ >= 0; }
+
+	void append(const char* logline, const size_t len);
+	void flush();
+	size_t writtenBytes() const { return writtenBytes_; }
+	int native_fd() const { return fd_; }
+
+private:
+	struct staging
+	{
+		char* data ;
+		size_t len ;		//已写入暂存区的字节数
+		size_t done ;		//内核已经写完的字节数,短写时从这里续写
+		off_t offset ;		//data[0]在文件中的位置
+		bool in_flight ;
+	};
+
+	bool setup(unsigned entries);
+	void submit(size_t index);
+	void submit_fsync();
+	bool push_sqe(const struct io_uring_sqe& sqe);
+	void reap(bool wait);
+	void complete(const struct io_uring_cqe& cqe);
+	int enter(unsigned to_submit , unsigned min_complete , unsigned flags);
+
+	static const boost::uint64_t kFsyncTag = ~static_cast<boost::uint64_t>(0);
+
+	std::string filename_ ;
+	int fd_ ;
+	int ring_fd_ ;
+	bool fdatasync_ ;
+	bool registered_ ;
+
+	void* sq_ptr_ ;
+	size_t sq_size_ ;
+	void* cq_ptr_ ;
+	size_t cq_size_ ;
+	struct io_uring_sqe* sqes_ ;
+	size_t sqes_size_ ;
+	unsigned* sq_head_ ;
+	unsigned* sq_tail_ ;
+	unsigned sq_mask_ ;
+	unsigned* sq_array_ ;
+	unsigned* cq_head_ ;
+	unsigned* cq_tail_ ;
+	unsigned cq_mask_ ;
+	struct io_uring_cqe* cqes_ ;
+
+	std::vector<staging> buffers_ ;
+	size_t buffer_size_ ;
+	size_t current_ ;
+	off_t offset_ ;			//下一个暂存区在文件中的起始位置
+	unsigned in_flight_ ;
+	bool fsync_in_flight_ ;
+	size_t writtenBytes_ ;
+};
+
+uring_file::uring_file(const std::string& filename , const file_options& options)
+: filename_(filename),
+fd_(-1),
+ring_fd_(-1),
+fdatasync_(options.uring_fdatasync),
+registered_(false),
+sq_ptr_(MAP_FAILED), sq_size_(0),
+cq_ptr_(MAP_FAILED), cq_size_(0),
+sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)), sqes_size_(0),
+sq_head_(NULL), sq_tail_(NULL), sq_mask_(0), sq_array_(NULL),
+cq_head_(NULL), cq_tail_(NULL), cq_mask_(0), cqes_(NULL),
+buffer_size_(options.uring_buffer_size < 4096 ? 4096 : options.uring_buffer_size),
+current_(0),
+offset_(0),
+in_flight_(0),
+fsync_in_flight_(false),
+writtenBytes_(0)
+{
+	size_t depth = options.uring_depth < 2 ? 2 : options.uring_depth ;
+	//写请求带显式偏移,不能用O_APPEND
+	fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+	if (fd_ < 0)
+	{
+		fprintf(stderr, "uring_file open %s failed %s\n", filename.c_str(), strerror(errno));
+		return ;
+	}
+	struct stat st ;
+	if (::fstat(fd_, &st) == 0)
+		offset_ = st.st_size ;
+
+	buffers_.resize(depth);
+	for (size_t i = 0; i < buffers_.size(); ++i)
+	{
+		staging& b = buffers_[i];
+		void* p = NULL ;
+		if (::posix_memalign(&p, 4096, buffer_size_) != 0)
+			p = NULL ;
+		b.data = static_cast<char*>(p);
+		b.len = b.done = 0 ;
+		b.offset = 0 ;
+		b.in_flight = false ;
+		if (b.data == NULL)
+			return ;
+	}
+	buffers_[0].offset = offset_ ;
+
+	//写请求加一个fsync,向上取2的幂
+	unsigned entries = 1 ;
+	while (entries < depth + 1)
+		entries <<= 1 ;
+	if (!setup(entries))
+		return ;
+
+	//注册缓冲区失败(例如RLIMIT_MEMLOCK太小)时用普通的IORING_OP_WRITE
+	std::vector<struct iovec> iov(buffers_.size());
+	for (size_t i = 0; i < buffers_.size(); ++i)
+	{
+		iov[i].iov_base = buffers_[i].data ;
+		iov[i].iov_len = buffer_size_ ;
+	}
+	registered_ = ::syscall(__NR_io_uring_register, ring_fd_, IORING_REGISTER_BUFFERS,
+		&iov[0], static_cast<unsigned>(iov.size())) == 0 ;
+}
+
+uring_file::~uring_file()
+{
+	if (ok())
+	{
+		flush();
+		while (in_flight_ > 0 || fsync_in_flight_)
+			reap(true);
+	}
+	if (sqes_ != MAP_FAILED)
+		::munmap(sqes_, sqes_size_);
+	if (cq_ptr_ != MAP_FAILED && cq_ptr_ != sq_ptr_)
+		::munmap(cq_ptr_, cq_size_);
+	if (sq_ptr_ != MAP_FAILED)
+		::munmap(sq_ptr_, sq_size_);
+	if (ring_fd_ >= 0)
+		::close(ring_fd_);
+	if (fd_ >= 0)
+		::close(fd_);
+	for (size_t i = 0; i < buffers_.size(); ++i)
+		::free(buffers_[i].data);
+}
+
+bool uring_file::setup(unsigned entries)
+{
+	struct io_uring_params p ;
+	memset(&p, 0, sizeof p);
+	int fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &p));
+	if (fd < 0)
+		return false ;
+
+	sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0 ;
+	if (single)
+		sq_size_ = cq_size_ = (sq_size_ > cq_size_ ? sq_size_ : cq_size_);
+
+	sq_ptr_ = ::mmap(NULL, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq_ptr_ == MAP_FAILED)
+	{
+		::close(fd);
+		return false ;
+	}
+	cq_ptr_ = single ? sq_ptr_ :
+		::mmap(NULL, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	sqes_size_ = p.sq_entries * sizeof(struct io_uring_sqe);
+	void* sqes = ::mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+	sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+	if (cq_ptr_ == MAP_FAILED || sqes == MAP_FAILED)
+	{
+		::close(fd);
+		return false ;
+	}
+
+	char* sq = static_cast<char*>(sq_ptr_);
+	sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+	sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+	sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+	sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+	char* cq = static_cast<char*>(cq_ptr_);
+	cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+	cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+	cq_mask_ = *reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+	cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+
+	ring_fd_ = fd ;
+	return true ;
+}
+
+int uring_file::enter(unsigned to_submit , unsigned min_complete , unsigned flags)
+{
+	int ret ;
+	do
+	{
+		ret = static_cast<int>(::syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, NULL, 0));
+	} while (ret < 0 && errno == EINTR);
+	return ret ;
+}
+
+//只有日志线程提交,队列不会被别人写满;满了说明完成队列没有及时收割
+bool uring_file::push_sqe(const struct io_uring_sqe& sqe)
+{
+	unsigned tail = *sq_tail_ ;
+	while (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) > sq_mask_)
+		reap(true);
+	unsigned index = tail & sq_mask_ ;
+	sqes_[index] = sqe ;
+	sq_array_[index] = index ;
+	__atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+	return enter(1, 0, 0) >= 0 ;
+}
+
+void uring_file::submit(size_t index)
+{
+	staging& b = buffers_[index];
+	struct io_uring_sqe sqe ;
+	memset(&sqe, 0, sizeof sqe);
+	sqe.opcode = registered_ ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE ;
+	sqe.fd = fd_ ;
+	sqe.off = b.offset + b.done ;
+	sqe.addr = reinterpret_cast<unsigned long>(b.data + b.done);
+	sqe.len = static_cast<unsigned>(b.len - b.done);
+	sqe.buf_index = static_cast<unsigned short>(index);
+	sqe.user_data = index ;
+	if (!b.in_flight)
+	{
+		b.in_flight = true ;
+		++in_flight_ ;
+	}
+	if (!push_sqe(sqe))
+	{
+		fprintf(stderr, "uring_file::submit() %s failed %s\n", filename_.c_str(), strerror(errno));
+		b.in_flight = false ;
+		--in_flight_ ;
+		b.len = b.done = 0 ;
+	}
+}
+
+//IOSQE_IO_DRAIN让fdatasync在之前提交的写全部完成后才执行
+void uring_file::submit_fsync()
+{
+	struct io_uring_sqe sqe ;
+	memset(&sqe, 0, sizeof sqe);
+	sqe.opcode = IORING_OP_FSYNC ;
+	sqe.flags = IOSQE_IO_DRAIN ;
+	sqe.fd = fd_ ;
+	sqe.fsync_flags = IORING_FSYNC_DATASYNC ;
+	sqe.user_data = kFsyncTag ;
+	fsync_in_flight_ = push_sqe(sqe);
+}
+
+void uring_file::complete(const struct io_uring_cqe& cqe)
+{
+	if (cqe.user_data == kFsyncTag)
+	{
+		fsync_in_flight_ = false ;
+		if (cqe.res < 0)
+			fprintf(stderr, "uring_file fdatasync %s failed %s\n", filename_.c_str(), strerror(-cqe.res));
+		return ;
+	}
+
+	staging& b = buffers_[static_cast<size_t>(cqe.user_data)];
+	if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+	{
+		submit(static_cast<size_t>(cqe.user_data));
+		return ;
+	}
+	if (cqe.res > 0 && b.done + cqe.res < b.len)
+	{
+		//短写,续写剩下的部分
+		b.done += cqe.res ;
+		submit(static_cast<size_t>(cqe.user_data));
+		return ;
+	}
+	if (cqe.res <= 0)
+		fprintf(stderr, "uring_file write %s failed %s\n", filename_.c_str(), strerror(cqe.res < 0 ? -cqe.res : EIO));
+	b.in_flight = false ;
+	b.len = b.done = 0 ;
+	--in_flight_ ;
+}
+
+void uring_file::reap(bool wait)
+{
+	if (wait && *cq_head_ == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+		enter(0, 1, IORING_ENTER_GETEVENTS);
+	for (;;)
+	{
+		//complete()续写时可能嵌套收割,每次都重新读head
+		unsigned head = *cq_head_ ;
+		if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE))
+			break ;
+		struct io_uring_cqe cqe = cqes_[head & cq_mask_];
+		__atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+		complete(cqe);
+	}
+}
+
+void uring_file::append(const char* logline, const size_t len)
+{
+	size_t n = 0 ;
+	while (n < len)
+	{
+		staging* b = &buffers_[current_];
+		while (b->in_flight)
+			reap(true);
+		if (b->len == 0)
+			b->offset = offset_ ;
+
+		size_t x = len - n ;
+		if (x > buffer_size_ - b->len)
+			x = buffer_size_ - b->len ;
+		memcpy(b->data + b->len, logline + n, x);
+		b->len += x ;
+		n += x ;
+		if (b->len == buffer_size_)
+		{
+			offset_ += b->len ;
+			submit(current_);
+			current_ = (current_ + 1) % buffers_.size();
+		}
+	}
+	writtenBytes_ += len ;
+	reap(false);
+}
+
+void uring_file::flush()
+{
+	staging& b = buffers_[current_];
+	if (b.len > 0 && !b.in_flight)
+	{
+		offset_ += b.len ;
+		submit(current_);
+		current_ = (current_ + 1) % buffers_.size();
+	}
+	if (fdatasync_ && !fsync_in_flight_)
+		submit_fsync();
+	reap(false);
+}
+
+file_engine* create_uring_file(const std::string& filename , const file_options& options)
+{
+	uring_file* file = new uring_file(filename, options);
+	if (!file->ok())
+	{
+		delete file ;
+		return NULL ;
+	}
+	return file ;
+}
+
+}
+
+#else
+
+namespace fst_log_file
+{
+
+file_engine* create_uring_file(const std::string& , const file_options&)
+{
+	return NULL ;
+}
+
+}
+
+#endif
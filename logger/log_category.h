@@ -0,0 +1,55 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_category.h
+file path:	logfile
+file base:	log_category
+file ext:	h
+author:
+
+purpose:	按名字分层的日志分类。"net.reactor"没有配置级别时继承"net",
+			再继承root。生效的级别已经和各sink中最低的级别合并好,
+			宏里判断是否输出只需要一次relaxed读。
+*********************************************************************/
+#ifndef __LOG_CATEGORY_INCLUDE__
+#define __LOG_CATEGORY_INCLUDE__
+
+#include <string>
+#include <boost/utility.hpp>
+#include <boost/atomic.hpp>
+#include "log_sink.h"
+
+namespace fst_log_file
+{
+
+	class logger ;
+
+	class log_category : boost::noncopyable
+	{
+	public:
+		log_category(const std::string& name , log_category* parent , unsigned id)
+			: name_(name) , parent_(parent) , id_(id) , configured_(-1) , level_(DEBUG_LEVEL) {}
+
+		const std::string& name() const { return name_; }
+		//从1开始按创建顺序编号,按分类分片时用
+		unsigned id() const { return id_; }
+		log_category* parent() const { return parent_; }
+		LogLevel level() const { return static_cast<LogLevel>(level_.load(boost::memory_order_relaxed)); }
+
+		bool enabled(LogLevel level) const
+		{
+			return level >= level_.load(boost::memory_order_relaxed);
+		}
+
+	private:
+		friend class logger ;
+
+		const std::string name_ ;
+		log_category* const parent_ ;	//root为NULL
+		const unsigned id_ ;
+		int configured_ ;				//配置的级别,-1表示继承上一级
+		boost::atomic<int> level_ ;		//生效的级别
+	};
+
+}
+
+#endif
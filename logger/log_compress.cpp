@@ -0,0 +1,125 @@
+#include "stdafx.h"
+#include <stdio.h>
+#include "log_compress.h"
+#include "log_lz.h"
+#include "threadctrl/threadctrl.h"
+#include "threadctrl/threadctrl_ext.h"
+#ifdef WIN32
+#include <windows.h>
+#elif defined(__linux__)
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+#include <boost/bind.hpp>
+
+namespace fst_log_file
+{
+
+//压缩线程只用空闲的CPU和磁盘带宽
+static void lower_thread_priority()
+{
+#if defined(WIN32)
+	::SetThreadPriority(::GetCurrentThread() , THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined(__linux__)
+	//linux下nice值是按线程的
+	pid_t tid = static_cast<pid_t>(::syscall(SYS_gettid));
+	::setpriority(PRIO_PROCESS , tid , 19);
+#ifdef SYS_ioprio_set
+	const int kIoprioWhoProcess = 1 ;
+	const int kIoprioClassIdle = 3 ;
+	::syscall(SYS_ioprio_set , kIoprioWhoProcess , tid , kIoprioClassIdle << 13);
+#endif
+#endif
+}
+
+log_compressor::log_compressor(int threads)
+: threads_count_(threads < 1 ? 1 : threads),
+running_(false)
+{
+	files_.store(0);
+	bytes_in_.store(0);
+	bytes_out_.store(0);
+	THREADCTL_ALLOC_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+	THREADCTL_ALLOC_COND(cond_);
+}
+
+log_compressor::~log_compressor()
+{
+	stop();
+	THREADCTL_FREE_COND(cond_);
+	THREADCTL_FREE_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+}
+
+//必须由shared_ptr持有
+void log_compressor::start()
+{
+	running_ = true ;
+	for (int i = 0; i < threads_count_; ++i)
+		threads_.push_back(new boost::thread(boost::bind(&log_compressor::threadFunc , this , shared_from_this())));
+}
+
+void log_compressor::set_stopping()
+{
+	lock_guard lock(mutex_);
+	running_ = false ;
+	THREADCTL_COND_BROADCAST(cond_);
+}
+
+void log_compressor::stop()
+{
+	if (threads_.empty())
+		return ;
+	set_stopping();
+	for (size_t i = 0; i < threads_.size(); ++i)
+		threads_[i].join();
+	threads_.clear();
+}
+
+void log_compressor::detach()
+{
+	if (threads_.empty())
+		return ;
+	set_stopping();
+	for (size_t i = 0; i < threads_.size(); ++i)
+		threads_[i].detach();
+	threads_.clear();
+}
+
+void log_compressor::submit(const std::string& filename)
+{
+	lock_guard lock(mutex_);
+	queue_.push_back(filename);
+	THREADCTL_COND_SIGNAL(cond_);
+}
+
+//self让detach之后的压缩器活到最后一个线程退出
+void log_compressor::threadFunc(boost::shared_ptr<log_compressor> /*self*/)
+{
+	lower_thread_priority();
+	for (;;)
+	{
+		std::string filename ;
+		{
+			lock_guard lock(mutex_);
+			while (running_ && queue_.empty())
+				THREADCTL_COND_WAIT(cond_ , mutex_);
+			if (queue_.empty())
+				break ;
+			filename = queue_.front();
+			queue_.pop_front();
+		}
+
+		lz::file_result result ;
+		if (lz::compress_file(filename , filename + ".lz" , &result))
+		{
+			files_.fetch_add(1 , boost::memory_order_relaxed);
+			bytes_in_.fetch_add(result.bytes_in , boost::memory_order_relaxed);
+			bytes_out_.fetch_add(result.bytes_out , boost::memory_order_relaxed);
+		}
+		else
+			fprintf(stderr, "log_compressor compress %s failed\n", filename.c_str());
+	}
+}
+
+}
@@ -0,0 +1,69 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_compress.h
+file path:	logfile
+file base:	log_compress
+file ext:	h
+author:
+
+purpose:	压缩滚动掉的日志文件。固定个数的低优先级线程从队列里取文件名,
+			压缩成同名的.lz文件后删除原文件,写日志的线程只负责入队。
+			线程持有压缩器的shared_ptr,detach后压缩器活到队列压完为止。
+*********************************************************************/
+#ifndef __LOG_COMPRESS_INCLUDE__
+#define __LOG_COMPRESS_INCLUDE__
+
+#include <string>
+#include <deque>
+#include <boost/utility.hpp>
+#include <boost/thread.hpp>
+#include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
+#include "log_stats.h"
+
+namespace fst_log_file
+{
+
+	class log_compressor : boost::noncopyable , public boost::enable_shared_from_this<log_compressor>
+	{
+	public:
+		//threads即同时压缩的文件数
+		explicit log_compressor(int threads);
+		~log_compressor();
+
+		void start();
+		//压完队列中剩下的文件后退出
+		void stop();
+		//不等待,线程压完队列中剩下的文件后自行退出
+		void detach();
+
+		//文件必须已经关闭,不会再被写
+		void submit(const std::string& filename);
+
+		boost::uint64_t files() const { return files_.load(boost::memory_order_relaxed); }
+		boost::uint64_t bytes_in() const { return bytes_in_.load(boost::memory_order_relaxed); }
+		boost::uint64_t bytes_out() const { return bytes_out_.load(boost::memory_order_relaxed); }
+
+	private:
+		void threadFunc(boost::shared_ptr<log_compressor> self);
+		void set_stopping();
+
+		const int threads_count_ ;
+		void* mutex_ ;
+		void* cond_ ;
+		bool running_ ;
+		std::deque<std::string> queue_ ;
+		boost::ptr_vector<boost::thread> threads_ ;
+
+		//多个压缩线程都会写
+		boost::atomic<boost::uint64_t> files_ ;
+		boost::atomic<boost::uint64_t> bytes_in_ ;
+		boost::atomic<boost::uint64_t> bytes_out_ ;
+	};
+
+	typedef boost::shared_ptr<log_compressor> log_compressor_ptr;
+
+}
+
+#endif
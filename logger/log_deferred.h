@@ -0,0 +1,168 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_deferred.h
+file path:	logfile
+file base:	log_deferred
+file ext:	h
+author:
+
+purpose:	延迟格式化。前端只拷贝调用点描述(log_site)的地址、时间戳
+			和参数的原始字节,文本格式化由后台日志线程完成。
+			记录格式: [deferred_header][参数字节],
+			site为NULL时参数字节就是已经格式化好的一行文本。
+*********************************************************************/
+#ifndef __LOG_DEFERRED_INCLUDE__
+#define __LOG_DEFERRED_INCLUDE__
+
+#include <string.h>
+#include <string>
+#include <boost/cstdint.hpp>
+#include <boost/utility/string_view.hpp>
+#include <boost/type_traits.hpp>
+#include <boost/utility/enable_if.hpp>
+#include "log_format.h"
+
+namespace fst_log_file
+{
+
+	//每个LOG_*_FMT调用点一个,静态常量初始化,地址即调用点编号
+	struct log_site
+	{
+		const char* fmt ;
+		int level ;
+		//按调用点的参数类型解码参数字节并格式化
+		void (*decode)(fmt::writer& w , const char* fmt , const char* args) ;
+	};
+
+	struct deferred_header
+	{
+		boost::uint32_t size ;		//整条记录的字节数,包括头
+		boost::uint32_t nsec ;
+		boost::int64_t sec ;
+		boost::uint64_t seq ;		//分片写文件时的全局序号,不分片时为0
+		const log_site* site ;		//NULL表示后面是格式化好的文本
+	};
+
+#ifdef FILELOGGER_HAS_CXX11
+namespace deferred
+{
+
+	//字符串类参数统一按[uint16 长度][内容]编码
+	struct string_tag {};
+
+	template<typename T , typename Enable = void>
+	struct codec_type { typedef T type; };
+
+	template<typename T>
+	struct codec_type<T , typename boost::enable_if_c<
+		boost::is_same<typename boost::remove_cv<typename boost::remove_pointer<typename boost::decay<T>::type>::type>::type , char>::value &&
+		boost::is_pointer<typename boost::decay<T>::type>::value>::type>
+	{ typedef string_tag type; };
+
+	template<> struct codec_type<std::string> { typedef string_tag type; };
+	template<> struct codec_type<boost::string_view> { typedef string_tag type; };
+
+	inline boost::string_view as_string(const char* s) { return s ? boost::string_view(s) : boost::string_view("(null)" , 6); }
+	inline boost::string_view as_string(const std::string& s) { return boost::string_view(s.data() , s.size()); }
+	inline boost::string_view as_string(boost::string_view s) { return s; }
+
+	template<typename T>
+	struct arg_codec
+	{
+		template<typename A>
+		static size_t size(const A&) { return sizeof(T); }
+
+		template<typename A>
+		static char* encode(char* p , const A& value)
+		{
+			T v = value;
+			memcpy(p , &v , sizeof v);
+			return p + sizeof v;
+		}
+
+		static const char* format(fmt::writer& w , const char* p)
+		{
+			T v;
+			memcpy(&v , p , sizeof v);
+			fmt::format_arg(w , v);
+			return p + sizeof v;
+		}
+	};
+
+	template<>
+	struct arg_codec<string_tag>
+	{
+		static size_t clamp(size_t len) { return len > 0xffff ? 0xffff : len; }
+
+		template<typename A>
+		static size_t size(const A& value) { return sizeof(boost::uint16_t) + clamp(as_string(value).size()); }
+
+		template<typename A>
+		static char* encode(char* p , const A& value)
+		{
+			boost::string_view s = as_string(value);
+			boost::uint16_t len = static_cast<boost::uint16_t>(clamp(s.size()));
+			memcpy(p , &len , sizeof len);
+			memcpy(p + sizeof len , s.data() , len);
+			return p + sizeof len + len;
+		}
+
+		static const char* format(fmt::writer& w , const char* p)
+		{
+			boost::uint16_t len;
+			memcpy(&len , p , sizeof len);
+			w.write(p + sizeof len , len);
+			return p + sizeof len + len;
+		}
+	};
+
+	inline size_t encoded_size() { return 0; }
+
+	template<typename T , typename... Args>
+	inline size_t encoded_size(const T& value , const Args&... args)
+	{
+		return arg_codec<typename codec_type<T>::type>::size(value) + encoded_size(args...);
+	}
+
+	inline char* encode(char* p) { return p; }
+
+	template<typename T , typename... Args>
+	inline char* encode(char* p , const T& value , const Args&... args)
+	{
+		return encode(arg_codec<typename codec_type<T>::type>::encode(p , value) , args...);
+	}
+
+	template<typename... Args>
+	struct decoder;
+
+	template<>
+	struct decoder<>
+	{
+		static void decode(fmt::writer& w , const char* fmt , const char*)
+		{
+			fmt::format_to(w , fmt);
+		}
+	};
+
+	template<typename T , typename... Rest>
+	struct decoder<T , Rest...>
+	{
+		static void decode(fmt::writer& w , const char* fmt , const char* args)
+		{
+			const char* next = fmt::copy_literal(w , fmt);
+			if (next == NULL)
+				return;
+			args = arg_codec<T>::format(w , args);
+			decoder<Rest...>::decode(w , next , args);
+		}
+	};
+
+	//只用于decltype,由调用点的参数类型得到解码器
+	template<size_t N , typename... Args>
+	decoder<typename codec_type<Args>::type...> site_decoder(const char (&fmt)[N] , const Args&...);
+
+}
+#endif
+}
+
+#endif
@@ -1,10 +1,21 @@
 #include "stdafx.h"
 #include <cassert>
+#include <algorithm>
 #include <boost/date_time.hpp>
 #include <boost/bind.hpp>
 #include "log_file.h"
+#ifdef WIN32
 #include <Winsock2.h>
 #include <Dbghelp.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
 #include <boost/algorithm/string.hpp>
 //#include "current_thread.h"
 #include "tinystr.h"
@@ -16,6 +27,48 @@
 
 using namespace fst_log_file;
 
+//本地时间,精确到毫秒
+struct local_time
+{
+	int year , month , day ;
+	int hour , minute , second ;
+	int millisec ;
+};
+
+static void get_local_time(local_time* lt)
+{
+#ifdef WIN32
+	SYSTEMTIME st ;
+	::GetLocalTime(&st);
+	lt->year = st.wYear ;
+	lt->month = st.wMonth ;
+	lt->day = st.wDay ;
+	lt->hour = st.wHour ;
+	lt->minute = st.wMinute ;
+	lt->second = st.wSecond ;
+	lt->millisec = st.wMilliseconds ;
+#else
+	//CLOCK_REALTIME_COARSE走vDSO,不陷入内核,精度为一个jiffy
+	struct timespec ts ;
+#ifdef CLOCK_REALTIME_COARSE
+	::clock_gettime(CLOCK_REALTIME_COARSE , &ts);
+#else
+	::clock_gettime(CLOCK_REALTIME , &ts);
+#endif
+	struct tm tm ;
+	::localtime_r(&ts.tv_sec , &tm);
+	lt->year = tm.tm_year + 1900 ;
+	lt->month = tm.tm_mon + 1 ;
+	lt->day = tm.tm_mday ;
+	lt->hour = tm.tm_hour ;
+	lt->minute = tm.tm_min ;
+	lt->second = tm.tm_sec ;
+	lt->millisec = static_cast<int>(ts.tv_nsec / 1000000) ;
+#endif
+}
+
+#ifdef WIN32
+
 fast_file::fast_file(const std::string& filename)
 : fp_(::fopen(filename.data(), "ab")),
 writtenBytes_(0)
@@ -61,13 +114,174 @@ size_t fast_file::write(const char* logline, size_t len)
 {
 	return ::_fwrite_nolock(logline, 1, len, fp_) ; 
 }
+int fast_file::native_fd() const
+{
+	return ::_fileno(fp_);
+}
+
+#else
+
+//posix下直接使用write(2),不经过stdio缓冲
+fast_file::fast_file(const std::string& filename)
+: fd_(::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644)),
+preallocated_(false),
+writtenBytes_(0)
+{
+	assert(fd_ >= 0);
+	if(fd_ < 0)
+		fprintf(stderr, "fast_file::fast_file() open %s failed %s\n", filename.c_str(), strerror(errno));
+}
+
+fast_file::~fast_file()
+{
+	if(fd_ < 0)
+		return ;
+	//截断到当前长度,释放预分配而没用到的块
+	struct stat st ;
+	if(preallocated_ && ::fstat(fd_, &st) == 0)
+		::ftruncate(fd_, st.st_size);
+	::close(fd_);
+}
+
+void fast_file::preallocate(size_t bytes)
+{
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+	if(fd_ >= 0 && ::fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, bytes) == 0)
+		preallocated_ = true ;
+#endif
+}
+void fast_file::append(const char* logline, const size_t len)
+{ 
+	size_t n = 0;
+	while (n < len)
+	{
+		size_t x = write(logline + n, len - n);
+		if (x == 0)
+		{
+			fprintf(stderr, "fast_file::append() failed %s\n", strerror(errno));
+			break;
+		}
+		n += x;
+	}
+
+	writtenBytes_ += len;
+
+}
+//一次writev写完一批。短写时跳过已经写完的段,写了一半的段用write补完,
+//再从下一段继续,不复制也不修改调用方的iovec
+void fast_file::append_batch(const log_iovec* vec, int count)
+{
+	const int kMaxIov = 1024 ;
+	size_t total = 0 ;
+	for (int i = 0; i < count; ++i)
+		total += vec[i].iov_len ;
+
+	int i = 0 ;
+	while (i < count && fd_ >= 0)
+	{
+		int n = std::min(count - i , kMaxIov);
+		ssize_t x = ::writev(fd_, vec + i, n);
+		if (x < 0 && errno == EINTR)
+			continue ;
+		if (x <= 0)
+		{
+			fprintf(stderr, "fast_file::append_batch() failed %s\n", strerror(errno));
+			break;
+		}
+		size_t done = static_cast<size_t>(x);
+		while (i < count && done >= vec[i].iov_len)
+			done -= vec[i++].iov_len ;
+		if (done > 0)
+		{
+			const char* rest = static_cast<const char*>(vec[i].iov_base) + done ;
+			size_t left = vec[i].iov_len - done ;
+			while (left > 0)
+			{
+				size_t written = write(rest, left);
+				if (written == 0)
+					break;
+				rest += written ;
+				left -= written ;
+			}
+			if (left > 0)
+			{
+				fprintf(stderr, "fast_file::append_batch() failed %s\n", strerror(errno));
+				break;
+			}
+			++i ;
+		}
+	}
+
+	writtenBytes_ += total;
+}
+
+void fast_file::flush()
+{
+	//write(2)没有用户态缓冲,数据已经交给内核
+}
+int fast_file::native_fd() const
+{
+	return fd_;
+}
+size_t fast_file::write(const char* logline, size_t len) 
+{
+	if(fd_ < 0)
+		return 0 ;
+
+	ssize_t n ;
+	do
+	{
+		n = ::write(fd_, logline, len);
+	} while (n < 0 && errno == EINTR);
+
+	return n > 0 ? static_cast<size_t>(n) : 0 ; 
+}
+
+#endif
+
+file_engine* fst_log_file::create_file_engine(const std::string& filename , const file_options& options)
+{
+	file_engine* file = NULL ;
+	const char* name = NULL ;
+	if(options.engine == FILE_ENGINE_URING)
+	{
+		file = create_uring_file(filename , options);
+		name = "io_uring" ;
+	}
+	else if(options.engine == FILE_ENGINE_DIRECT)
+	{
+		file = create_direct_file(filename , options);
+		name = "O_DIRECT" ;
+	}
+	else if(options.engine == FILE_ENGINE_MMAP)
+	{
+		file = create_mmap_file(filename , options);
+		name = "mmap" ;
+	}
+	else if(options.engine == FILE_ENGINE_LZ)
+	{
+		file = create_lz_file(filename , options);
+		name = "lz" ;
+	}
+	if(file)
+		return file ;
 
+	//只提示一次,之后每次滚动文件都静默回退
+	static bool warned = false ;
+	if(name && !warned)
+	{
+		warned = true ;
+		fprintf(stderr, "%s unavailable, %s falls back to write(2)\n", name , filename.c_str());
+	}
+	return new fast_file(filename);
+}
 
 log_file::log_file(const std::string& basename,
 				   size_t rollSize,
 				   int checkEveryN ,
 				   bool threadSafe/* = true*/ , 
-				   int flushInterval /*= 3*/)
+				   int flushInterval /*= 3*/,
+				   const file_options& options)
 				   : basename_(basename),
 				   flushInterval_(flushInterval),
 				   lastRoll_(0),
@@ -75,20 +289,51 @@ log_file::log_file(const std::string& basename,
 				   rollSize_(rollSize),
 				   count_(0),
 				   checkEveryN_(checkEveryN),
-				   lastFlush_(0)
+				   lastFlush_(0),
+				   options_(options)
 {
 	if(threadSafe)
 		THREADCTL_ALLOC_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
 	else
 		mutex_ = NULL ; 
 
+	//mmap按rollSize预分配,写到这个大小时正好滚动
+	if(options_.mmap_size == 0)
+		options_.mmap_size = rollSize_ ;
+
+	if(options_.durability != DURABILITY_NONE)
+	{
+		syncer_.reset(new log_syncer(options_));
+		syncer_->start();
+	}
+
+	//已经是压缩格式的文件不再压缩
+	if(options_.compress && options_.engine != FILE_ENGINE_LZ)
+	{
+		compressor_.reset(new log_compressor(options_.compress_threads));
+		compressor_->start();
+	}
+
+	//windows下打开着的文件不能改名
+#ifndef WIN32
+	if(options_.precreate)
+	{
+		precreator_.reset(new file_precreator(basename_ , options_ , rollSize_));
+		if(compressor_)
+			precreator_->set_on_closed(boost::bind(&log_compressor::submit , compressor_.get() , _1));
+		precreator_->start();
+	}
+#endif
+
 	rollFile();
 
 }
 
 log_file::~log_file()
 {
-
+	//没有close时压缩线程还持有压缩器
+	if(compressor_)
+		compressor_->detach();
 }
 
 void log_file::append(const char* logline, int len)
@@ -108,23 +353,134 @@ void log_file::flush()
 	if(mutex_)
 	{
 		lock_guard guard(mutex_);
-		file_->flush();
+		flush_unlocked();
+	}
+	else
+		flush_unlocked();
+
+
+}
+
+void log_file::close(bool wait_compress)
+{
+	if(mutex_)
+	{
+		lock_guard guard(mutex_);
+		flush_unlocked();
+		file_.reset();
 	}
 	else
-		file_->flush();
+	{
+		flush_unlocked();
+		file_.reset();
+	}
+	if(precreator_)
+		precreator_->stop();
+	if(compressor_)
+	{
+		if(wait_compress)
+			compressor_->stop();
+		else
+			compressor_->detach();
+	}
+	if(syncer_)
+		syncer_->stop();
+}
+
+void log_file::request_sync()
+{
+	if(syncer_ && options_.durability == DURABILITY_ON_ERROR)
+		syncer_->request_sync();
+}
+
+void log_file::flush_unlocked()
+{
+	boost::uint64_t start = stats_now_ns();
+	file_->flush();
+	flush_latency_.record(stats_now_ns() - start);
+}
 
+void log_file::get_stats(log_file_stats* stats) const
+{
+	stats->bytes_written = bytes_written_.get();
+	stats->rolls = rolls_.get();
+	stats->precreated_rolls = precreated_rolls_.get();
+	write_latency_.snapshot(&stats->write_latency);
+	flush_latency_.snapshot(&stats->flush_latency);
+	roll_latency_.snapshot(&stats->roll_latency);
+	if(compressor_)
+	{
+		stats->compressed_files = compressor_->files();
+		stats->compress_bytes_in = compressor_->bytes_in();
+		stats->compress_bytes_out = compressor_->bytes_out();
+	}
+	else
+		stats->compressed_files = stats->compress_bytes_in = stats->compress_bytes_out = 0 ;
+	if(syncer_)
+	{
+		stats->syncs = syncer_->syncs();
+		syncer_->sync_latency(&stats->sync_latency);
+	}
+	else
+	{
+		stats->syncs = 0 ;
+		stats->sync_latency.clear();
+	}
+}
 
+void log_file::append_batch(const log_iovec* vec, int count)
+{
+	if(mutex_)
+	{
+		lock_guard guard(mutex_);
+		append_batch_unlocked(vec, count);
+	}
+	else
+		append_batch_unlocked(vec, count);
 }
+
 void log_file::append_unlocked(const char* logline, int len)
 {
+	boost::uint64_t start = stats_now_ns();
 	file_->append(logline, len);
+	write_latency_.record(stats_now_ns() - start);
+	bytes_written_.add(len);
+	after_append_unlocked(1);
+}
+
+void log_file::append_batch_unlocked(const log_iovec* vec, int count)
+{
+	int i = 0 ;
+	while (i < count)
+	{
+		//写到使文件超过rollSize的那个buffer为止,其余的在滚动后写进新文件;
+		//同一秒内不能滚动时文件已经超过rollSize,每次只写一个buffer
+		size_t written = file_->writtenBytes();
+		size_t bytes = vec[i].iov_len ;
+		int j = i + 1 ;
+		while (j < count && written + bytes <= rollSize_)
+			bytes += vec[j++].iov_len ;
+
+		boost::uint64_t start = stats_now_ns();
+		file_->append_batch(vec + i, j - i);
+		write_latency_.record(stats_now_ns() - start);
+		bytes_written_.add(bytes);
+		after_append_unlocked(j - i);
+		i = j ;
+	}
+}
+
+void log_file::after_append_unlocked(int appended)
+{
+	if (syncer_)
+		syncer_->written(file_->writtenBytes());
 	if (file_->writtenBytes() > rollSize_)
 	{
 		rollFile();
 	}
 	else
 	{
-		++count_;
+		count_ += appended;
 		if (count_ >= checkEveryN_)
 		{
 			count_ = 0;
@@ -137,7 +493,7 @@ void log_file::append_unlocked(const char* logline, int len)
 			else if (now - lastFlush_ > flushInterval_)
 			{
 				lastFlush_ = now;
-				file_->flush();
+				flush_unlocked();
 			}
 		}
 	}
@@ -148,14 +504,48 @@ bool log_file::rollFile()
 {
 	time_t now = 0;
 	std::string filename = getLogFileName(basename_, &now);
+	if (options_.engine == FILE_ENGINE_LZ)
+		filename += ".lz";
 	time_t start = now / kRollPerSeconds_ * kRollPerSeconds_;
 
 	if (now > lastRoll_)
 	{
+		boost::uint64_t roll_start = stats_now_ns();
 		lastRoll_ = now;
 		lastFlush_ = now;
 		startOfPeriod_ = start;
-		file_.reset(new fast_file(filename));
+		file_engine_ptr next ;
+		if (precreator_)
+			next = precreator_->take(filename);
+		if (next)
+			precreated_rolls_.add(1);
+		else
+			next.reset(create_file_engine(filename , options_));
+
+		//旧文件先把暂存的数据交给内核,再交给后台线程关闭
+		if (precreator_ && file_)
+		{
+			file_->flush();
+			precreator_->retire(file_ , filename_);
+		}
+		file_.swap(next);
+		next.reset();
+		//没有预创建时旧文件已经在上面关闭了
+		if (compressor_ && !precreator_ && !filename_.empty())
+			compressor_->submit(filename_);
+		filename_ = filename;
+		if (syncer_)
+		{
+			//同步线程用自己的副本,旧文件关闭后仍能把它落盘
+			int fd = file_->native_fd();
+#ifdef WIN32
+			syncer_->set_file(fd >= 0 ? ::_dup(fd) : -1);
+#else
+			syncer_->set_file(fd >= 0 ? ::dup(fd) : -1);
+#endif
+		}
+		roll_latency_.record(stats_now_ns() - roll_start);
+		rolls_.add(1);
 		return true;
 	}
 	return false;
@@ -170,17 +560,19 @@ std::string log_file::getLogFileName(const std::string& basename, time_t* now)
 	char timebuf[32];
 	struct tm tm;
 	*now = time(NULL);
+#ifdef WIN32
 	gmtime_s(&tm , now );
+#else
+	gmtime_r(now , &tm );
+#endif
 	strftime(timebuf, sizeof timebuf, ".%Y%m%d-%H%M%S", &tm);
 	filename += timebuf;
 
-#ifdef WIN32
-	SYSTEMTIME st ;
-	::GetLocalTime(&st);
-	char buffer_milsec[10] ;
-	sprintf_s(buffer_milsec , "-%d" , st.wMilliseconds);
+	local_time lt ;
+	get_local_time(&lt);
+	char buffer_milsec[16] ;
+	snprintf(buffer_milsec , sizeof buffer_milsec , "-%d" , lt.millisec);
 	filename+=buffer_milsec ; 
-#endif
 
 	filename += ".log";
 
@@ -189,26 +581,80 @@ std::string log_file::getLogFileName(const std::string& basename, time_t* now)
 
 
 
-async_logging::async_logging(const std::string& basename,int flushInterval/* = 3*/)
-:flushInterval_(flushInterval),
+const char* logLevelStr[NULL_LEVEL] = {
+	"D",
+	"I",
+	"W",
+	"E",
+} ;
+
+//每个async_logging实例的唯一编号,线程局部缓存用它判断是否命中
+static boost::atomic<unsigned long> g_async_logging_id(0);
+
+//线程局部的前端状态缓存,命中时不需要查thread_specific_ptr
+struct producer_cache
+{
+	unsigned long owner ;
+	void* self ;
+};
+static LOG_THREAD_LOCAL producer_cache tls_producer_cache = { 0 , NULL };
+
+//后台线程每轮最多从环形缓冲中取出的buffer数
+static const size_t kMaxDrainBuffers = 16 ;
+
+//前端的current、next加上后台的两个
+static const size_t kMinPoolBuffers = 4 ;
+
+//OVERFLOW_DROP_BY_LEVEL下不会被丢弃的最低级别
+static const LogLevel kKeepLevel = WARN_LEVEL ;
+
+async_logging::async_logging(const std::string& basename,int flushInterval/* = 3*/ ,
+							 const async_options& options)
+:options_(options),
+id_(++g_async_logging_id),
+flushInterval_(flushInterval),
 running_(false),
 basename_(basename),
-currentBuffer_(new Buffer()),
-nextBuffer_(new Buffer()),
+currentBuffer_(new Buffer(options.buffer_size), BufferPtr::deleter_type()),
+nextBuffer_(new Buffer(options.buffer_size), BufferPtr::deleter_type()),
 buffers_(),
-latch_(1)
+latch_(1),
+log_thread(NULL),
+ring_cursor_(0),
+reopen_pending_(false),
+sleeping_(false),
+record_format_(FORMAT_TEXT),
+swaps_at_second_(0),
+reported_drops_(0)
 {
 	THREADCTL_ALLOC_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+	THREADCTL_ALLOC_LOCK(producers_mutex_ , THREADCTL_LOCKTYPE_READWRITE);
 	THREADCTL_ALLOC_COND(cond_) ; 
 
 	currentBuffer_->bzero();
 	nextBuffer_->bzero();
 	buffers_.reserve(16);
+	memset(&retired_stats_ , 0 , sizeof retired_stats_);
+
+	//其余的buffer预先分配好放进缓冲池,bzero让页面提前就位
+	const size_t pool_count = std::max(options_.buffer_count , kMinPoolBuffers) - 2 ;
+	free_buffers_.reserve(pool_count);
+	for (size_t i = 0; i < pool_count; ++i)
+	{
+		free_buffers_.push_back(new Buffer(options_.buffer_size));
+		free_buffers_.back().bzero();
+	}
+
+	if (options_.transport == TRANSPORT_MPSC_QUEUE)
+		queue_.reset(new mpsc_queue(options_.queue_slots , MAX_LOG_RECORD_SIZE));
 }
 
 async_logging::~async_logging()
 {
 	stop();
+	THREADCTL_FREE_COND(cond_);
+	THREADCTL_FREE_LOCK(producers_mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+	THREADCTL_FREE_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
 }
 
 void async_logging::start()
@@ -223,7 +669,7 @@ void async_logging::stop()
 	if(log_thread)
 	{
 	running_ = false;
-	THREADCTL_COND_BROADCAST(cond_);
+	wakeup();
 	log_thread->join(); 
 	delete log_thread ;
 	log_thread = NULL ; 
@@ -232,13 +678,55 @@ void async_logging::stop()
 }
 
 
-void async_logging::append(const char* logline, int len)
+void async_logging::append(const char* logline, int len, LogLevel level)
 {
-	lock_guard lock(mutex_) ; 
+	producer* self = this_producer();
+	if (options_.transport == TRANSPORT_THREAD_RING)
+		append_ring(self, logline, len, level);
+	else if (options_.transport == TRANSPORT_MPSC_QUEUE)
+		append_queue(self, logline, len, level);
+	else
+		append_locked(self, logline, len, level);
+}
+
+void async_logging::append_locked(producer* self , const char* logline, int len, LogLevel level)
+{
+	//先试着加锁,拿不到时才计时,没有竞争时不读时钟
+	if (!THREADCTL_TRY_LOCK_(mutex_))
+	{
+		boost::uint64_t start = stats_now_ns();
+		THREADCTL_LOCK(mutex_ , THREADCTL_WRITE);
+		self->lock_wait.record(stats_now_ns() - start);
+	}
+	adopt_lock_guard lock(mutex_) ;
+
+	//后台线程积压,按照overflow_policy处理
+	if (currentBuffer_->avail() <= len && buffers_.size() >= options_.max_pending_buffers)
+	{
+		if (options_.overflow_policy == OVERFLOW_DROP_OLDEST)
+		{
+			BufferPtr oldest = buffers_.release(buffers_.begin());
+			self->evicted(*oldest);
+			oldest->reset_buffer();
+
+			buffers_.push_back(currentBuffer_.release());
+			currentBuffer_ = boost::ptr_container::move(oldest);
+			currentBuffer_->append(logline, len, level);
+			self->accepted(level , len);
+			THREADCTL_COND_BROADCAST(cond_);
+			return ;
+		}
+
+		if (!wait_locked(self , level))
+		{
+			self->dropped(level , len);
+			return ;
+		}
+	}
 
 	if (currentBuffer_->avail() > len)
 	{
-		currentBuffer_->append(logline, len);
+		currentBuffer_->append(logline, len, level);
 	}
 	else
 	{
@@ -250,246 +738,1920 @@ void async_logging::append(const char* logline, int len)
 		}
 		else
 		{
-			currentBuffer_.reset(new Buffer);
+			take_buffer_locked(currentBuffer_);
 		}
-		currentBuffer_->append(logline, len);
+		currentBuffer_->append(logline, len, level);
 		THREADCTL_COND_BROADCAST(cond_);
 	}
+	self->accepted(level , len);
 }
 
-
-void async_logging::threadFunc()
+void async_logging::append_ring(producer* self , const char* logline, int len, LogLevel level)
 {
-	assert(running_ == true);
-	log_file output(basename_   ,4*FILE_SIZE_1M, 256 ,false );
-	BufferPtr newBuffer1(new Buffer());
-	BufferPtr newBuffer2(new Buffer());
-	newBuffer1->bzero();
-	newBuffer2->bzero();
-	BufferVector buffersToWrite;
-	buffersToWrite.reserve(16);
-
-	latch_.countdown();
+	spsc_ring* ring = self->ring.get();
 
-	while (running_)
+	//环形缓冲满了,按照overflow_policy决定是否叫醒后台线程、让出CPU等它取走
+	if (!ring->push(logline, len, level))
 	{
-		assert(newBuffer1 && newBuffer1->length() == 0);
-		assert(newBuffer2 && newBuffer2->length() == 0);
-		assert(buffersToWrite.empty());
+		const log_timestamp deadline = block_deadline();
+		do
+		{
+			if (!keep_waiting(level , deadline))
+			{
+				self->dropped(level , len);
+				return ;
+			}
+			wakeup();
+			boost::this_thread::yield();
+		} while (!ring->push(logline, len, level));
+		self->blocked.add(1);
+	}
+	self->accepted(level , len);
 
-		{ //mutex scope 
-			lock_guard lock(mutex_) ; 
+	//超过一半时才去叫醒后台线程,平时不碰任何锁
+	if (sleeping_.load(boost::memory_order_relaxed) &&
+		ring->size() > ring->capacity() / 2)
+	{
+		wakeup();
+	}
+}
 
-			timeval wait_time;
-			wait_time.tv_sec =flushInterval_;
-			wait_time.tv_usec = 0 ;
-			if (buffers_.empty()) {
-				THREADCTL_COND_WAIT_TIMED(cond_ , mutex_ ,&wait_time);
-			}
+void async_logging::append_queue(producer* self , const char* logline, int len, LogLevel level)
+{
+	if (len > static_cast<int>(MAX_LOG_RECORD_SIZE))
+	{
+		self->dropped(level , len);
+		return ;
+	}
 
-			buffers_.push_back(currentBuffer_.release());
-			currentBuffer_ = boost::ptr_container::move(newBuffer1);
-			buffersToWrite.swap(buffers_);
-			if (!nextBuffer_)
+	//队列满了,按照overflow_policy决定是否叫醒后台线程、让出CPU等它取走
+	if (!queue_->push(logline, len, level))
+	{
+		const log_timestamp deadline = block_deadline();
+		do
+		{
+			if (!keep_waiting(level , deadline))
 			{
-				nextBuffer_ = boost::ptr_container::move(newBuffer2);
+				self->dropped(level , len);
+				return ;
 			}
-		} //end mutex scope 
+			wakeup();
+			boost::this_thread::yield();
+		} while (!queue_->push(logline, len, level));
+		self->blocked.add(1);
+	}
+	self->accepted(level , len);
 
-		assert(!buffersToWrite.empty());
+	if (sleeping_.load(boost::memory_order_relaxed) &&
+		queue_->size() > queue_->capacity() / 2)
+	{
+		wakeup();
+	}
+}
 
-		if (buffersToWrite.size() > 25) //ǰ־дٶȹ ,buffer
-		{
-			char buf[256];
-			sprintf_s(buf, sizeof buf, "Dropped log messages  %d larger buffers\n",
-				buffersToWrite.size()-2);
-			fputs(buf, stderr);
+//OVERFLOW_BLOCK下前端等待的截止时间
+log_timestamp async_logging::block_deadline() const
+{
+	log_timestamp deadline ;
+	log_clock_now(&deadline , TIME_PRECISION_MS);
+	deadline.sec += options_.block_timeout_ms / 1000 ;
+	deadline.nsec += (options_.block_timeout_ms % 1000) * 1000000L ;
+	if (deadline.nsec >= 1000000000L)
+	{
+		deadline.sec += 1 ;
+		deadline.nsec -= 1000000000L ;
+	}
+	return deadline ;
+}
 
-			buffersToWrite.erase(buffersToWrite.begin()+2, buffersToWrite.end());
-		}
+//积压时前端是否继续等待,返回false表示丢弃当前这条
+bool async_logging::keep_waiting(LogLevel level , const log_timestamp& deadline)
+{
+	if (!running_)
+		return false ;
+	if (options_.overflow_policy == OVERFLOW_DROP_BY_LEVEL)
+		return level >= kKeepLevel ;
+	if (options_.overflow_policy != OVERFLOW_BLOCK)
+		return false ;
 
-		for (size_t i = 0; i < buffersToWrite.size(); ++i)
-		{
-			output.append(buffersToWrite[i].data(), buffersToWrite[i].length());
-		}
+	log_timestamp now ;
+	log_clock_now(&now , TIME_PRECISION_MS);
+	return now.sec < deadline.sec || (now.sec == deadline.sec && now.nsec < deadline.nsec) ;
+}
 
-		if (buffersToWrite.size() > 2) //ֻbuffer
+//持有mutex_时等待后台线程取走积压的buffer,返回false表示丢弃当前这条
+bool async_logging::wait_locked(producer* self , LogLevel level)
+{
+	const log_timestamp deadline = block_deadline();
+	while (buffers_.size() >= options_.max_pending_buffers)
+	{
+		if (!keep_waiting(level , deadline))
+			return false ;
+
+		THREADCTL_COND_BROADCAST(cond_);
+		timeval wait_time;
+		wait_time.tv_sec = 0 ;
+		wait_time.tv_usec = 10*1000 ;
+		THREADCTL_COND_WAIT_TIMED(cond_ , mutex_ ,&wait_time);
+	}
+	self->blocked.add(1);
+	return true ;
+}
+
+//drop_oldest丢弃了一个已接收的buffer
+void async_logging::producer::evicted(const LogBuffer& buffer)
+{
+	for (int level = 0; level < NULL_LEVEL; ++level)
+	{
+		dropped_records[level].add(buffer.records(static_cast<LogLevel>(level)));
+		dropped_bytes[level].add(buffer.bytes(static_cast<LogLevel>(level)));
+	}
+	evicted_records.add(buffer.records());
+}
+
+//当前线程在这个async_logging上的计数和环形缓冲,第一次调用时创建
+async_logging::producer* async_logging::this_producer()
+{
+	producer_cache& cache = tls_producer_cache ;
+	if (cache.owner == id_)
+		return static_cast<producer*>(cache.self) ;
+
+	producer_holder* holder = producer_holder_.get();
+	if (holder == NULL)
+	{
+		ProducerPtr self(new producer);
+		if (options_.transport == TRANSPORT_THREAD_RING)
+			self->ring.reset(new spsc_ring(options_.ring_size));
+		{
+			lock_guard lock(producers_mutex_);
+			producers_.push_back(self);
+		}
+		holder = new producer_holder(self);
+		producer_holder_.reset(holder);
+	}
+
+	cache.owner = id_ ;
+	cache.self = holder->self.get() ;
+	return holder->self.get() ;
+}
+
+//线程已经退出、环形缓冲也已取空的前端,计数并入retired_stats_后释放
+void async_logging::reap_producers_locked()
+{
+	for (size_t i = 0; i < producers_.size(); )
+	{
+		const producer& p = *producers_[i];
+		if (p.retired.load(boost::memory_order_acquire) && (!p.ring || p.ring->empty()))
+		{
+			merge_producer(p , &retired_stats_);
+			producers_[i] = producers_.back();
+			producers_.pop_back();
+		}
+		else
+			++i;
+	}
+}
+
+void async_logging::merge_producer(const producer& p , async_logging_stats* stats)
+{
+	for (int level = 0; level < NULL_LEVEL; ++level)
+	{
+		stats->accepted[level].records += p.accepted_records[level].get();
+		stats->accepted[level].bytes += p.accepted_bytes[level].get();
+		stats->dropped[level].records += p.dropped_records[level].get();
+		stats->dropped[level].bytes += p.dropped_bytes[level].get();
+	}
+	stats->evicted += p.evicted_records.get();
+	stats->blocked += p.blocked.get();
+
+	histogram_snapshot lock_wait ;
+	p.lock_wait.snapshot(&lock_wait);
+	stats->lock_wait.merge(lock_wait);
+}
+
+void async_logging::get_stats(async_logging_stats* stats)
+{
+	{
+		lock_guard lock(producers_mutex_);
+		reap_producers_locked();
+		*stats = retired_stats_ ;
+		for (size_t i = 0; i < producers_.size(); ++i)
+			merge_producer(*producers_[i] , stats);
+	}
+
+	boost::uint64_t accepted = 0 ;
+	boost::uint64_t written = 0 ;
+	for (int level = 0; level < NULL_LEVEL; ++level)
+	{
+		stats->written[level].records = written_records_[level].get();
+		stats->written[level].bytes = written_bytes_[level].get();
+		accepted += stats->accepted[level].records ;
+		written += stats->written[level].records ;
+	}
+	//各计数不是同一时刻读到的,只保证不出现负数
+	stats->queue_depth = accepted > written + stats->evicted ? accepted - written - stats->evicted : 0 ;
+	stats->queue_high_water = queue_high_water_.get();
+	stats->buffer_swaps = buffer_swaps_.get();
+
+	//后台线程只在写入时更新每秒交换次数,超过一秒没有更新说明这段时间没有交换
+	stats->swaps_per_sec = swaps_per_sec_.get();
+	if (static_cast<boost::uint64_t>(::time(NULL)) > swaps_second_.get() + 1)
+		stats->swaps_per_sec = 0 ;
+
+	lock_guard lock(producers_mutex_);
+	if (output_)
+		output_->get_stats(&stats->file);
+	else
+		memset(&stats->file , 0 , sizeof stats->file);
+}
+
+void async_logging::get_overflow_stats(overflow_stats* stats)
+{
+	async_logging_stats all ;
+	get_stats(&all);
+	memset(stats , 0 , sizeof(*stats));
+	for (int level = 0; level < NULL_LEVEL; ++level)
+	{
+		stats->dropped_records += all.dropped[level].records ;
+		stats->dropped_bytes += all.dropped[level].bytes ;
+	}
+	stats->blocked = all.blocked ;
+}
+
+void async_logging::wakeup()
+{
+	lock_guard lock(mutex_) ; 
+	THREADCTL_COND_BROADCAST(cond_);
+}
+
+bool async_logging::has_pending()
+{
+	if (queue_)
+		return !queue_->empty();
+
+	lock_guard lock(producers_mutex_);
+	for (size_t i = 0; i < producers_.size(); ++i)
+	{
+		if (producers_[i]->ring && !producers_[i]->ring->empty())
+			return true ;
+	}
+	return false ;
+}
+
+//无锁传递方式下没有数据时,在条件变量上最多等待flushInterval_
+void async_logging::wait_lock_free()
+{
+	lock_guard lock(mutex_) ; 
+	sleeping_.store(true);
+	if (running_ && !has_pending())
+	{
+		timeval wait_time;
+		wait_time.tv_sec =flushInterval_;
+		wait_time.tv_usec = 0 ;
+		THREADCTL_COND_WAIT_TIMED(cond_ , mutex_ ,&wait_time);
+	}
+	sleeping_.store(false);
+}
+
+bool async_logging::drain_lock_free(BufferPtr& current , BufferPtr& spare , BufferVector& buffersToWrite)
+{
+	bool drained = queue_ ? drain_queue(current , spare , buffersToWrite)
+		: drain_rings(current , spare , buffersToWrite) ;
+
+	if (current->length() > 0)
+	{
+		buffersToWrite.push_back(current.release());
+		if (spare)
+			current = boost::ptr_container::move(spare);
+	}
+	return drained ;
+}
+
+//current放不下len字节时换一个buffer,buffersToWrite已满时返回false
+bool async_logging::reserve_buffer(BufferPtr& current , BufferPtr& spare , BufferVector& buffersToWrite , int len)
+{
+	if (current->avail() > len)
+		return true ;
+	if (buffersToWrite.size() + 1 >= kMaxDrainBuffers)
+		return false ;
+
+	buffersToWrite.push_back(current.release());
+	if (spare)
+		current = boost::ptr_container::move(spare);
+	else
+	{
+		lock_guard lock(mutex_) ; 
+		take_buffer_locked(current);
+	}
+	return true ;
+}
+
+//从缓冲池取一个空buffer,池空了才分配新的,调用方需持有mutex_
+void async_logging::take_buffer_locked(BufferPtr& buffer)
+{
+	if (!free_buffers_.empty())
+		buffer = free_buffers_.pop_back();
+	else
+		buffer.reset(new Buffer(options_.buffer_size), BufferPtr::deleter_type());
+}
+
+//写完的buffer放回缓冲池,池中超过buffer_count的部分释放掉
+void async_logging::recycle_buffers(BufferVector& buffers)
+{
+	for (size_t i = 0; i < buffers.size(); ++i)
+		buffers[i].reset_buffer();
+
+	lock_guard lock(mutex_) ; 
+	free_buffers_.transfer(free_buffers_.end(), buffers.begin(), buffers.end(), buffers);
+	while (free_buffers_.size() > options_.buffer_count)
+		free_buffers_.pop_back();
+}
+
+bool async_logging::drain_queue(BufferPtr& current , BufferPtr& spare , BufferVector& buffersToWrite)
+{
+	bool drained = false ;
+	int len ;
+	unsigned level ;
+	while ((len = queue_->front_length(&level)) >= 0)
+	{
+		if (!reserve_buffer(current , spare , buffersToWrite , len))
+			break;
+		queue_->pop(current->current(), len);
+		current->add(len, static_cast<LogLevel>(level));
+		drained = true ;
+	}
+	return drained ;
+}
+
+//从各线程的环形缓冲取出日志,填满的buffer放入buffersToWrite
+bool async_logging::drain_rings(BufferPtr& current , BufferPtr& spare , BufferVector& buffersToWrite)
+{
+	bool drained = false ;
+	lock_guard lock(producers_mutex_);
+
+	const size_t count = producers_.size();
+	bool full = false ;
+	for (size_t n = 0; n < count && !full; ++n)
+	{
+		spsc_ring* ring = producers_[(ring_cursor_ + n) % count]->ring.get();
+		int len ;
+		unsigned level ;
+		while ((len = ring->front_length(&level)) >= 0)
+		{
+			if (!reserve_buffer(current , spare , buffersToWrite , len))
+			{
+				full = true ;
+				break;
+			}
+			ring->pop(current->current(), len);
+			current->add(len, static_cast<LogLevel>(level));
+			drained = true ;
+		}
+	}
+	if (count > 0)
+		ring_cursor_ = (ring_cursor_ + 1) % count ;
+
+	//线程已经退出且取空的环形缓冲可以释放了
+	reap_producers_locked();
+	return drained ;
+}
+
+void async_logging::threadFunc()
+{
+	assert(running_ == true);
+	{
+		lock_guard lock(producers_mutex_) ; 
+		output_.reset(new log_file(basename_   ,4*FILE_SIZE_1M, 256 ,false , 2 , options_.file));
+	}
+	BufferPtr newBuffer1;
+	BufferPtr newBuffer2;
+	{
+		lock_guard lock(mutex_) ; 
+		take_buffer_locked(newBuffer1);
+		take_buffer_locked(newBuffer2);
+	}
+	BufferVector buffersToWrite;
+	buffersToWrite.reserve(16);
+	if (options_.deferred)
+		render_buffer_.reset(new RenderBuffer);
+
+	latch_.countdown();
+
+	const bool lock_free = (options_.transport != TRANSPORT_LOCKED) ;
+	while (running_)
+	{
+		assert(newBuffer1 && newBuffer1->length() == 0);
+		assert(newBuffer2 && newBuffer2->length() == 0);
+		assert(buffersToWrite.empty());
+
+		if (reopen_pending_.load(boost::memory_order_acquire))
+			reopen_output();
+
+		if (lock_free)
+		{
+			if (!drain_lock_free(newBuffer1 , newBuffer2 , buffersToWrite))
+			{
+				wait_lock_free();
+				drain_lock_free(newBuffer1 , newBuffer2 , buffersToWrite);
+			}
+
+			if (buffersToWrite.empty())
+			{
+				output_->flush();
+				continue;
+			}
+		}
+		else
+		{ //mutex scope 
+			lock_guard lock(mutex_) ; 
+
+			timeval wait_time;
+			wait_time.tv_sec =flushInterval_;
+			wait_time.tv_usec = 0 ;
+			if (buffers_.empty()) {
+				THREADCTL_COND_WAIT_TIMED(cond_ , mutex_ ,&wait_time);
+			}
+
+			buffers_.push_back(currentBuffer_.release());
+			currentBuffer_ = boost::ptr_container::move(newBuffer1);
+			buffersToWrite.swap(buffers_);
+			if (!nextBuffer_)
+			{
+				nextBuffer_ = boost::ptr_container::move(newBuffer2);
+			}
+			//叫醒因为积压在等待的前端
+			THREADCTL_COND_BROADCAST(cond_);
+		} //end mutex scope 
+
+		write_generation(*output_ , buffersToWrite , newBuffer1 , newBuffer2);
+	}//for
+
+	//退出前把无锁队列中剩余的日志写完
+	if (lock_free)
+	{
+		while (drain_lock_free(newBuffer1 , newBuffer2 , buffersToWrite) || !buffersToWrite.empty())
+			write_generation(*output_ , buffersToWrite , newBuffer1 , newBuffer2);
+	}
+	else
+	{
+		//stop()可能在本线程进入等待之前就清了running_,当前buffer和积压的都还没写
+		{
+			lock_guard lock(mutex_) ; 
+			if (currentBuffer_->length() > 0)
+			{
+				buffers_.push_back(currentBuffer_.release());
+				currentBuffer_ = boost::ptr_container::move(newBuffer1);
+			}
+			buffersToWrite.swap(buffers_);
+		}
+		if (!buffersToWrite.empty())
+			write_generation(*output_ , buffersToWrite , newBuffer1 , newBuffer2);
+	}
+	report_dropped(*output_);
+	//异步引擎的请求属于提交它的线程,必须在本线程内等它们完成
+	output_->close();
+}
+
+void async_logging::reopen(const std::string& basename)
+{
+	{
+		lock_guard lock(mutex_) ; 
+		reopen_basename_ = basename ;
+		reopen_pending_.store(true , boost::memory_order_release);
+	}
+	wakeup();
+}
+
+//在后台线程里调用,之前取走的buffer都已经写进旧文件
+void async_logging::reopen_output()
+{
+	std::string basename ;
+	{
+		lock_guard lock(mutex_) ; 
+		basename.swap(reopen_basename_);
+		reopen_pending_.store(false , boost::memory_order_relaxed);
+	}
+	if (basename.empty() || basename == basename_)
+		return ;
+
+	boost::scoped_ptr<log_file> next(new log_file(basename ,4*FILE_SIZE_1M, 256 ,false , 2 , options_.file));
+	{
+		lock_guard lock(producers_mutex_) ; 
+		output_.swap(next);
+		basename_ = basename ;
+	}
+	//换下来的旧文件已经不会被其他线程读到,在锁外关闭。
+	//不等旧文件的压缩,否则积压的文件压完之前日志都写不进去
+	next->close(false);
+	//旧文件的滚动等线程在这里结束,压缩线程压完队列后自行退出
+}
+
+//把deferred_header记录格式化成文本,攒在staging中成批写入文件
+void async_logging::render_deferred(log_file& output , const Buffer& buffer , RenderBuffer& staging)
+{
+	const char* p = buffer.data();
+	const char* end = p + buffer.length();
+	while (p + sizeof(deferred_header) <= end)
+	{
+		deferred_header head ;
+		memcpy(&head , p , sizeof head);
+		if (head.size < sizeof head || head.size > static_cast<size_t>(end - p))
+			break;
+
+		if (staging.avail() <= MAX_LOG_TEXT_SIZE)
+		{
+			output.append(staging.data(), staging.length());
+			staging.reset_buffer();
+		}
+
+		const char* payload = p + sizeof head ;
+		if (head.site == NULL)
+		{
+			staging.append(payload , head.size - sizeof head);
+		}
+		else
+		{
+			fmt::writer w(staging.current() , MAX_LOG_TEXT_SIZE);
+			log_timestamp ts ;
+			ts.sec = static_cast<time_t>(head.sec);
+			ts.nsec = head.nsec ;
+			w.add(format_log_time(w.current() , ts , options_.time_precision));
+			w.put(',');
+			w.put(logLevelStr[head.site->level][0]);
+			w.put(',');
+			if (options_.shards > 1)
+			{
+				w.put('#');
+				fmt::write_unsigned(w , head.seq);
+				w.put(',');
+			}
+			head.site->decode(w , head.site->fmt , payload);
+			w.write(LOG_EOL , sizeof(LOG_EOL) - 1);
+			if (!w.overflow())
+				staging.add(w.length());
+		}
+		p += head.size ;
+	}
+}
+
+void async_logging::write_generation(log_file& output , BufferVector& buffersToWrite ,
+									 BufferPtr& newBuffer1 , BufferPtr& newBuffer2)
+{
+	assert(!buffersToWrite.empty());
+
+	if (render_buffer_)
+	{
+		for (size_t i = 0; i < buffersToWrite.size(); ++i)
+			render_deferred(output , buffersToWrite[i] , *render_buffer_);
+	}
+	else
+	{
+		//整代buffer一次提交,write引擎下只有一次writev
+		batch_.clear();
+		for (size_t i = 0; i < buffersToWrite.size(); ++i)
+		{
+			if (buffersToWrite[i].length() == 0)
+				continue ;
+			log_iovec v ;
+			v.iov_base = const_cast<char*>(buffersToWrite[i].data());
+			v.iov_len = buffersToWrite[i].length();
+			batch_.push_back(v);
+		}
+		if (!batch_.empty())
+			output.append_batch(&batch_[0], static_cast<int>(batch_.size()));
+	}
+	if (render_buffer_ && render_buffer_->length() > 0)
+	{
+		output.append(render_buffer_->data(), render_buffer_->length());
+		render_buffer_->reset_buffer();
+	}
+	count_written(buffersToWrite);
+
+	bool has_error = false ;
+	for (size_t i = 0; i < buffersToWrite.size() && !has_error; ++i)
+		has_error = buffersToWrite[i].records(WARN_LEVEL) + buffersToWrite[i].records(ERR_LEVEL) > 0 ;
+
+	if (!newBuffer1)
+	{
+		assert(!buffersToWrite.empty());
+		newBuffer1 = buffersToWrite.pop_back();
+		newBuffer1->reset_buffer();
+	}
+
+	if (!newBuffer2)
+	{
+		assert(!buffersToWrite.empty());
+		newBuffer2 = buffersToWrite.pop_back();
+		newBuffer2->reset_buffer();
+	}
+
+	//其余的buffer放回缓冲池
+	recycle_buffers(buffersToWrite);
+	report_dropped(output);
+	output.flush();
+	if (has_error)
+		output.request_sync();
+}
+
+//写入的记录按级别计数,同时统计buffer交换次数和一次取走的最多记录数
+void async_logging::count_written(const BufferVector& buffers)
+{
+	time_t now = ::time(NULL);
+	if (static_cast<boost::uint64_t>(now) != swaps_second_.get())
+	{
+		//进入新的一秒,发布上一秒的交换次数,中间隔了不止一秒时为0
+		boost::uint64_t total = buffer_swaps_.get();
+		swaps_per_sec_.set(static_cast<boost::uint64_t>(now) == swaps_second_.get() + 1 ? total - swaps_at_second_ : 0);
+		swaps_at_second_ = total ;
+		swaps_second_.set(now);
+	}
+	buffer_swaps_.add(buffers.size());
+
+	boost::uint64_t records = 0 ;
+	for (size_t i = 0; i < buffers.size(); ++i)
+	{
+		const Buffer& buffer = buffers[i];
+		for (int level = 0; level < NULL_LEVEL; ++level)
+		{
+			written_records_[level].add(buffer.records(static_cast<LogLevel>(level)));
+			written_bytes_[level].add(buffer.bytes(static_cast<LogLevel>(level)));
+		}
+		records += buffer.records();
+	}
+	queue_high_water_.set_max(records);
+}
+
+//前端因为积压丢弃了日志时,在stderr和日志文件中各记一行,文件里的按文件记录的格式编码
+void async_logging::report_dropped(log_file& output)
+{
+	boost::uint64_t dropped = 0 ;
+	{
+		lock_guard lock(producers_mutex_);
+		reap_producers_locked();
+		for (int level = 0; level < NULL_LEVEL; ++level)
+		{
+			dropped += retired_stats_.dropped[level].records ;
+			for (size_t i = 0; i < producers_.size(); ++i)
+				dropped += producers_[i]->dropped_records[level].get();
+		}
+	}
+	if (dropped == reported_drops_)
+		return ;
+
+	char buf[256];
+	int len = snprintf(buf, sizeof buf, "Dropped log messages %llu records, %llu in total" LOG_EOL,
+		static_cast<unsigned long long>(dropped - reported_drops_),
+		static_cast<unsigned long long>(dropped));
+	fputs(buf, stderr);
+	RecordFormat format = static_cast<RecordFormat>(record_format_.load(boost::memory_order_relaxed));
+	if (format != FORMAT_TEXT)
+	{
+		static const char msg[] = "Dropped log messages" ;
+		log_timestamp ts ;
+		log_clock_now(&ts , options_.time_precision);
+		fmt::writer w(buf , sizeof buf);
+		kv::write_head(w , format , ts , options_.time_precision , WARN_LEVEL , msg , sizeof msg - 1);
+		kv::write_key(w , format , "dropped");
+		kv::write_value(w , format , dropped - reported_drops_);
+		kv::write_key(w , format , "total");
+		kv::write_value(w , format , dropped);
+		kv::write_tail(w , format);
+		len = w.overflow() ? -1 : static_cast<int>(w.length());
+	}
+	if (len > 0 && len < static_cast<int>(sizeof buf))
+		output.append(buf, len);
+	reported_drops_ = dropped ;
+}
+
+
+boost::atomic<int> fst_log_file::g_log_level_threshold(DEBUG_LEVEL);
+
+logger::~logger()
+{
+	watcher_.reset();
+	delete snapshot_.load(boost::memory_order_relaxed);
+}
+
+//保留上次的log_dst,和以前的init一样,没有加载过配置时不输出
+void logger::init(const std::string& log_in_dir ,const std::string&basename ,LogLevel level)
+{
+	logger_snapshot* retired = NULL ;
+	{
+		boost::mutex::scoped_lock lock(config_mutex_);
+		logger_settings settings = settings_ ;
+		settings.basename = basename ;
+		settings.log_dir = log_in_dir ;
+		settings.console_level = settings.file_level = level ;
+		apply_settings_locked(settings , &retired);
+	}
+	retire_snapshot(retired);
+}
+
+//调用方没有指定线程库时,使用本平台的原生实现,否则锁和条件变量都为空操作。
+//创建任何带锁的对象之前都要先调用
+static void use_default_threads_if_unset()
+{
+	if(threadctl_lock_fns_.alloc == NULL)
+		threadctl_use_default_threads();
+}
+
+static boost::shared_ptr<log_sink> find_entry(const logger_snapshot& snapshot , const std::string& key)
+{
+	for(size_t i = 0; i < snapshot.sinks.size(); ++i)
+	{
+		if(snapshot.sinks[i].key == key)
+			return snapshot.sinks[i].sink ;
+	}
+	return boost::shared_ptr<log_sink>();
+}
+
+static void add_entry(logger_snapshot& snapshot , const std::string& key , LogLevel level ,
+	RecordFormat format , const boost::shared_ptr<log_sink>& sink)
+{
+	logger_snapshot::entry entry ;
+	entry.key = key ;
+	entry.level = level ;
+	entry.format = format ;
+	entry.sink = sink ;
+	snapshot.sinks.push_back(entry);
+}
+
+//在config_mutex_内调用。上一个快照中key相同的sink沿用,其余新建并启动。
+//传递方式、格式等在file_sink创建时确定,重新加载只改变级别、输出目的、目录和文件名
+bool logger::apply_settings_locked(const logger_settings& settings , logger_snapshot** retired)
+{
+	use_default_threads_if_unset();
+
+	std::string log_dir = settings.log_dir ;
+	if(settings.file && !create_log_dir(log_dir))
+		return false ;
+
+	//stop()之后的sink都已经停止,不能再沿用
+	const logger_snapshot stopped ;
+	const logger_snapshot& current = *snapshot_.load(boost::memory_order_relaxed);
+	const logger_snapshot& prev = stopped_ ? stopped : current ;
+
+	logger_snapshot* next = new logger_snapshot ;
+	next->deferred = settings.async.deferred ;
+	next->time_precision = settings.async.time_precision ;
+	if(settings.console)
+	{
+		std::string key = "console:" + settings.console_output.key();
+		boost::shared_ptr<log_sink> sink = find_entry(prev , key);
+		if(!sink)
+		{
+			sink.reset(new console_sink(settings.console_output));
+			sink->start();
+		}
+		add_entry(*next , key , settings.console_level , settings.console_format , sink);
+	}
+
+	if(settings.file)
+	{
+		std::string basename = log_dir + settings.basename ;
+		boost::shared_ptr<log_sink> sink = find_entry(prev , "file");
+		file_sink* file = static_cast<file_sink*>(sink.get());
+		if(file == NULL)
+		{
+			file = new file_sink(basename , 2 , settings.async);
+			sink.reset(file);
+			file->start();
+		}
+		else if(file->basename() != basename)
+			file->reopen(basename);
+		file->set_record_format(settings.file_format);
+		add_entry(*next , "file" , settings.file_level , settings.file_format , sink);
+		next->file = file ;
+		next->file_level = settings.file_level ;
+		//延迟格式化的记录由后台线程渲染成文本,文件选了其他格式时不用
+		next->deferred = file->options().deferred && settings.file_format == FORMAT_TEXT ;
+		next->time_precision = file->options().time_precision ;
+	}
+
+	for(size_t i = 0; i < settings.sinks.size(); ++i)
+	{
+		const sink_options& options = settings.sinks[i];
+		std::string key = "sink:" + options.key();
+		if(find_entry(*next , key))
+			continue ;
+		boost::shared_ptr<log_sink> sink = find_entry(prev , key);
+		if(!sink)
+		{
+			log_sink* created = create_sink(options);
+			if(created == NULL)
+			{
+				printf("error:不支持的 sink type[%s]\r\n" , options.type.c_str() );
+				continue ;
+			}
+			sink.reset(created);
+			sink->start();
+		}
+		add_entry(*next , key , options.level , options.format , sink);
+	}
+
+	//add_sink增加的不在配置文件里,一直保留
+	for(size_t i = 0; i < current.sinks.size(); ++i)
+	{
+		if(current.sinks[i].key.compare(0 , 4 , "api:") != 0)
+			continue ;
+		if(stopped_)
+			current.sinks[i].sink->start();
+		next->sinks.push_back(current.sinks[i]);
+	}
+
+	set_category_levels(settings.categories);
+	*retired = publish_locked(next);
+	settings_ = settings ;
+	stopped_ = false ;
+	return true ;
+}
+
+//新快照对之后进入临界区的读者可见,返回换下来的旧快照
+logger_snapshot* logger::publish_locked(logger_snapshot* next)
+{
+	int threshold = NULL_LEVEL ;
+	LogLevel text_level = NULL_LEVEL ;
+	for(int format = 0; format < FORMAT_COUNT; ++format)
+		next->format_level[format] = NULL_LEVEL ;
+	for(size_t i = 0; i < next->sinks.size(); ++i)
+	{
+		LogLevel level = next->sinks[i].level ;
+		if(level < threshold)
+			threshold = level ;
+		if(next->sinks[i].sink.get() != next->file && level < text_level)
+			text_level = level ;
+		RecordFormat format = next->sinks[i].format ;
+		if(level < next->format_level[format])
+			next->format_level[format] = level ;
+	}
+	next->threshold = static_cast<LogLevel>(threshold) ;
+	next->text_level = text_level ;
+
+	logger_snapshot* prev = snapshot_.exchange(next , boost::memory_order_acq_rel);
+	g_log_level_threshold.store(threshold , boost::memory_order_relaxed);
+	update_category_levels();
+	return prev ;
+}
+
+//在config_mutex_之外调用:等还在用旧快照的读者都离开后删除它,
+//不再被引用的sink在这里写完已经接收的日志并停止,可能要等它们的线程结束
+void logger::retire_snapshot(logger_snapshot* snapshot)
+{
+	if(snapshot == NULL)
+		return ;
+	rcu_.synchronize();
+	delete snapshot ;
+}
+
+void logger::add_sink(log_sink* sink , LogLevel level , RecordFormat format)
+{
+	boost::shared_ptr<log_sink> owned(sink);
+	logger_snapshot* retired ;
+	{
+		boost::mutex::scoped_lock lock(config_mutex_);
+		logger_snapshot* next = new logger_snapshot(*snapshot_.load(boost::memory_order_relaxed));
+		add_entry(*next , "api:" + sink->name() , level , format , owned);
+		sink->start();
+		retired = publish_locked(next);
+	}
+	retire_snapshot(retired);
+}
+
+log_sink* logger::find_sink(const std::string& name)
+{
+	rcu_read_guard guard(rcu_);
+	const logger_snapshot& snapshot = *snapshot_.load(boost::memory_order_acquire);
+	for(size_t i = 0; i < snapshot.sinks.size(); ++i)
+	{
+		if(snapshot.sinks[i].sink->name() == name)
+			return snapshot.sinks[i].sink.get();
+	}
+	return NULL ;
+}
+
+void logger::get_sink_stats(std::vector<sink_stats>* stats)
+{
+	rcu_read_guard guard(rcu_);
+	const logger_snapshot& snapshot = *snapshot_.load(boost::memory_order_acquire);
+	stats->resize(snapshot.sinks.size());
+	for(size_t i = 0; i < snapshot.sinks.size(); ++i)
+		snapshot.sinks[i].sink->get_stats(&(*stats)[i]);
+}
+
+//创建目录并在末尾补上分隔符
+bool logger::create_log_dir(std::string& log_dir)
+{
+#ifdef WIN32
+	std::string::size_type pos = 0;
+	while(std::string::npos != (pos = log_dir.find('/', pos)))
+	{
+		log_dir.replace(pos, 1, "\\");
+		pos += 1;
+	}
+	if(log_dir.empty() || log_dir.at(log_dir.size()-1)!='\\')
+		log_dir+="\\" ; 
+
+	BOOL result = MakeSureDirectoryPathExists(log_dir.c_str());
+	if(result == FALSE)
+	{
+		printf("MakeSureDirectoryPathExists error:[%s]\r\n" ,log_dir.c_str() );
+	}
+	return result ;
+#else
+	//mkdir -p
+	if(log_dir.empty())
+		log_dir = "./" ;
+	if(log_dir.at(log_dir.size()-1)!='/')
+		log_dir+="/" ; 
+
+	std::string::size_type pos = 0;
+	while(std::string::npos != (pos = log_dir.find('/', pos + 1)))
+	{
+		std::string sub_dir = log_dir.substr(0 , pos);
+		if(::mkdir(sub_dir.c_str() , 0755) != 0 && errno != EEXIST)
+		{
+			printf("mkdir error:[%s] %s\r\n" ,sub_dir.c_str() , strerror(errno) );
+			return false ;
+		}
+	}
+
+	struct stat st ;
+	if(::stat(log_dir.c_str() , &st) != 0 || !S_ISDIR(st.st_mode))
+	{
+		printf("create_log_dir error:[%s] is not a directory\r\n" ,log_dir.c_str() );
+		return false ;
+	}
+	return true ;
+#endif
+}
+
+log_category& logger::get(const std::string& name)
+{
+	return sln_logger::instance().category(name);
+}
+
+log_category& logger::category(const std::string& name)
+{
+	spin_guard lock(categories_lock_);
+	return *find_category_locked(name);
+}
+
+log_category* logger::find_category_locked(const std::string& name)
+{
+	boost::ptr_map<std::string , log_category>::iterator it = categories_.find(name);
+	if(it != categories_.end())
+		return it->second ;
+
+	log_category* parent = NULL ;
+	if(!name.empty())
+	{
+		std::string::size_type dot = name.rfind('.');
+		parent = find_category_locked(dot == std::string::npos ? std::string() : name.substr(0 , dot));
+	}
+	log_category* category = new log_category(name , parent , static_cast<unsigned>(categories_.size() + 1));
+	std::string key(name);
+	categories_.insert(key , category);
+	category->level_.store(category_level_locked(category) , boost::memory_order_relaxed);
+	return category ;
+}
+
+//向上找到第一个配置了级别的分类,都没有配置时不限制;再和各sink中最低的级别取较高的
+int logger::category_level_locked(const log_category* category) const
+{
+	while(category != NULL && category->configured_ < 0)
+		category = category->parent_ ;
+	int level = category != NULL ? category->configured_ : DEBUG_LEVEL ;
+	return std::max(level , g_log_level_threshold.load(boost::memory_order_relaxed));
+}
+
+void logger::update_category_levels()
+{
+	spin_guard lock(categories_lock_);
+	for(boost::ptr_map<std::string , log_category>::iterator it = categories_.begin(); it != categories_.end(); ++it)
+		it->second->level_.store(category_level_locked(it->second) , boost::memory_order_relaxed);
+}
+
+//再次加载时,这次没有出现的分类恢复为继承
+void logger::set_category_levels(const std::vector<std::pair<std::string , LogLevel> >& categories)
+{
+	spin_guard lock(categories_lock_);
+	for(boost::ptr_map<std::string , log_category>::iterator it = categories_.begin(); it != categories_.end(); ++it)
+		it->second->configured_ = -1 ;
+	for(size_t i = 0; i < categories.size(); ++i)
+		find_category_locked(categories[i].first)->configured_ = categories[i].second ;
+}
+
+//日志头:时间,级别,
+int logger::format_head(char* buffer , TimePrecision precision , LogLevel level)
+{
+	log_timestamp ts ;
+	log_clock_now(&ts , precision);
+	int head_len = format_log_time(buffer , ts , precision);
+	buffer[head_len++] = ',';
+	buffer[head_len++] = logLevelStr[level][0];
+	buffer[head_len++] = ',';
+	return head_len ;
+}
+
+void logger::log(LogLevel level ,const char *logstr, ... )
+{
+	if(!log_level_enabled(level))
+		return ; 
+
+	va_list args;
+	va_start( args, logstr );
+	vlog(0 , level , logstr , args);
+	va_end( args );
+}
+
+void logger::log_cat(const log_category& cat , LogLevel level ,const char *logstr, ... )
+{
+	if(!cat.enabled(level))
+		return ; 
+
+	va_list args;
+	va_start( args, logstr );
+	vlog(cat.id() , level , logstr , args);
+	va_end( args );
+}
+
+void logger::vlog(size_t key , LogLevel level , const char* logstr , va_list args)
+{
+	rcu_read_guard guard(rcu_);
+	const logger_snapshot& snapshot = *snapshot_.load(boost::memory_order_acquire);
+
+	char buffer[MAX_LOG_BUFFER_SIZE] ; 
+	const int eol_len = sizeof(LOG_EOL) - 1 ;
+
+	int head_len = format_head(buffer , snapshot.time_precision , level);
+
+	//直接格式化到buffer,放不下时丢弃整条日志
+	int avail = MAX_LOG_BUFFER_SIZE - head_len - eol_len ;
+	int len = vsnprintf( &buffer[head_len], avail, logstr, args );
+	if(len < 0 || len >= avail)
+		return ;
+
+	memcpy(&buffer[head_len + len] , LOG_EOL , eol_len);
+	output(snapshot , level , buffer , head_len + len + eol_len , true , key);
+}
+
+//每种格式只转换一次
+void logger::output(const logger_snapshot& snapshot , LogLevel level , const char* buffer , int len , bool to_file , size_t key)
+{
+	if(level >= snapshot.format_level[FORMAT_TEXT])
+		output_format(snapshot , FORMAT_TEXT , level , buffer , len , to_file , key);
+
+	for(int format = FORMAT_TEXT + 1; format < FORMAT_COUNT; ++format)
+	{
+		if(level < snapshot.format_level[format])
+			continue ;
+		char converted[MAX_LOG_BUFFER_SIZE] ; 
+		int converted_len = kv::convert_text(converted , sizeof converted , static_cast<RecordFormat>(format) , level , buffer , len);
+		if(converted_len > 0)
+			output_format(snapshot , static_cast<RecordFormat>(format) , level , converted , converted_len , to_file , key);
+		else
+			count_oversized(snapshot , static_cast<RecordFormat>(format) , level , to_file);
+	}
+}
+
+void logger::count_oversized(const logger_snapshot& snapshot , RecordFormat format , LogLevel level , bool to_file)
+{
+	for(size_t i = 0; i < snapshot.sinks.size(); ++i)
+	{
+		const logger_snapshot::entry& entry = snapshot.sinks[i];
+		if(entry.format == format && level >= entry.level && (to_file || entry.sink.get() != snapshot.file))
+			entry.sink->count_oversized();
+	}
+}
+
+//只有需要排队的sink才把记录复制到堆上,而且只复制一次
+void logger::output_format(const logger_snapshot& snapshot , RecordFormat format , LogLevel level , const char* buffer , int len , bool to_file , size_t key)
+{
+	log_record_ref record(level , buffer , len , key , format);
+	for(size_t i = 0; i < snapshot.sinks.size(); ++i)
+	{
+		const logger_snapshot::entry& entry = snapshot.sinks[i];
+		if(entry.format == format && level >= entry.level && (to_file || entry.sink.get() != snapshot.file))
+			entry.sink->write(record);
+	}
+}
+
+file_sink::file_sink(const std::string& basename , int flushInterval , const async_options& options)
+: log_sink("file"),
+options_(options),
+basename_(basename)
+{
+	sequence_.store(0);
+	size_t count = options.shards > 1 ? options.shards : 1 ;
+	for(size_t i = 0; i < count; ++i)
+		shards_.push_back(new async_logging(shard_basename(basename , i) , flushInterval , options));
+}
+
+std::string file_sink::shard_basename(const std::string& basename , size_t index) const
+{
+	if(options_.shards <= 1)
+		return basename ;
+	char suffix[32] ;
+	snprintf(suffix , sizeof suffix , ".s%u" , static_cast<unsigned>(index));
+	return basename + suffix ;
+}
+
+//每个线程第一次写日志时取一个编号,相邻的线程落在不同分片
+size_t file_sink::thread_key()
+{
+	static boost::atomic<size_t> next_key(0);
+	static LOG_THREAD_LOCAL size_t key = 0 ;
+	if(key == 0)
+		key = next_key.fetch_add(1 , boost::memory_order_relaxed) + 1 ;
+	return key ;
+}
+
+void file_sink::start()
+{
+	for(size_t i = 0; i < shards_.size(); ++i)
+		shards_[i].start();
+}
+
+void file_sink::stop()
+{
+	for(size_t i = 0; i < shards_.size(); ++i)
+		shards_[i].stop();
+}
+
+void file_sink::reopen(const std::string& basename)
+{
+	basename_ = basename ;
+	for(size_t i = 0; i < shards_.size(); ++i)
+		shards_[i].reopen(shard_basename(basename , i));
+}
+
+void file_sink::set_record_format(RecordFormat format)
+{
+	for(size_t i = 0; i < shards_.size(); ++i)
+		shards_[i].set_record_format(format);
+}
+
+void file_sink::write(log_record_ref& record)
+{
+	const char* data = record.data();
+	int len = record.length();
+	char buffer[MAX_LOG_RECORD_SIZE] ;
+	size_t head_size = options_.deferred ? sizeof(deferred_header) : 0 ;
+
+	if(sharded())
+	{
+		//序号插在时间和级别之后:文本为"#序号,",json为"seq":序号,,logfmt为seq=序号。
+		//记录不超过MAX_LOG_BUFFER_SIZE,加上序号不超过MAX_LOG_TEXT_SIZE
+		const char separator = record.format() == FORMAT_LOGFMT ? ' ' : ',' ;
+		const char* end = data + len ;
+		const char* p = static_cast<const char*>(memchr(data , separator , len));
+		if(p)
+			p = static_cast<const char*>(memchr(p + 1 , separator , end - p - 1));
+		p = p ? p + 1 : data ;
+
+		fmt::writer w(buffer + head_size , MAX_LOG_TEXT_SIZE);
+		w.write(data , p - data);
+		if(record.format() == FORMAT_JSON)
+			w.write("\"seq\":" , 6);
+		else if(record.format() == FORMAT_LOGFMT)
+			w.write("seq=" , 4);
+		else
+			w.put('#');
+		fmt::write_unsigned(w , next_sequence());
+		w.put(separator);
+		w.write(p , end - p);
+		if(w.overflow())
+		{
+			count_oversized();
+			return ;
+		}
+		len = w.length();
+		data = buffer + head_size ;
+	}
+
+	if(options_.deferred)
+	{
+		//延迟格式化模式下,已经格式化好的文本也要加上记录头,序号已经在文本里
+		deferred_header head ;
+		head.size = static_cast<boost::uint32_t>(sizeof head + len);
+		head.nsec = 0 ;
+		head.sec = 0 ;
+		head.seq = 0 ;
+		head.site = NULL ;
+		memcpy(buffer , &head , sizeof head);
+		if(data != buffer + head_size)
+			memcpy(buffer + sizeof head , data , len);
+		shard(record.shard_key()).append(buffer , head.size , record.level());
+	}
+	else
+		shard(record.shard_key()).append(data , len , record.level());
+}
+
+void file_sink::get_logging_stats(async_logging_stats* stats)
+{
+	memset(stats , 0 , sizeof(*stats));
+	for(size_t i = 0; i < shards_.size(); ++i)
+	{
+		async_logging_stats shard_stats ;
+		shards_[i].get_stats(&shard_stats);
+		for(int level = 0; level < NULL_LEVEL; ++level)
+		{
+			stats->accepted[level].records += shard_stats.accepted[level].records ;
+			stats->accepted[level].bytes += shard_stats.accepted[level].bytes ;
+			stats->written[level].records += shard_stats.written[level].records ;
+			stats->written[level].bytes += shard_stats.written[level].bytes ;
+			stats->dropped[level].records += shard_stats.dropped[level].records ;
+			stats->dropped[level].bytes += shard_stats.dropped[level].bytes ;
+		}
+		stats->evicted += shard_stats.evicted ;
+		stats->blocked += shard_stats.blocked ;
+		stats->queue_depth += shard_stats.queue_depth ;
+		stats->queue_high_water = std::max(stats->queue_high_water , shard_stats.queue_high_water);
+		stats->buffer_swaps += shard_stats.buffer_swaps ;
+		stats->swaps_per_sec += shard_stats.swaps_per_sec ;
+		stats->lock_wait.merge(shard_stats.lock_wait);
+
+		log_file_stats& file = stats->file ;
+		const log_file_stats& shard_file = shard_stats.file ;
+		file.bytes_written += shard_file.bytes_written ;
+		file.rolls += shard_file.rolls ;
+		file.precreated_rolls += shard_file.precreated_rolls ;
+		file.write_latency.merge(shard_file.write_latency);
+		file.flush_latency.merge(shard_file.flush_latency);
+		file.roll_latency.merge(shard_file.roll_latency);
+		file.syncs += shard_file.syncs ;
+		file.sync_latency.merge(shard_file.sync_latency);
+		file.compressed_files += shard_file.compressed_files ;
+		file.compress_bytes_in += shard_file.compress_bytes_in ;
+		file.compress_bytes_out += shard_file.compress_bytes_out ;
+	}
+}
+
+void file_sink::get_overflow_stats(overflow_stats* stats)
+{
+	memset(stats , 0 , sizeof(*stats));
+	for(size_t i = 0; i < shards_.size(); ++i)
+	{
+		overflow_stats shard_stats ;
+		shards_[i].get_overflow_stats(&shard_stats);
+		stats->dropped_records += shard_stats.dropped_records ;
+		stats->dropped_bytes += shard_stats.dropped_bytes ;
+		stats->blocked += shard_stats.blocked ;
+	}
+}
+
+void file_sink::get_stats(sink_stats* stats)
+{
+	log_sink::get_stats(stats);
+	async_logging_stats file_stats ;
+	get_logging_stats(&file_stats);
+	for(int level = 0; level < NULL_LEVEL; ++level)
+	{
+		stats->records += file_stats.written[level].records ;
+		stats->bytes += file_stats.written[level].bytes ;
+		stats->dropped += file_stats.dropped[level].records ;
+	}
+	stats->queue_depth = file_stats.queue_depth ;
+}
+
+static void trim_space_and_lower(std::string& str)
+{
+	boost::trim(str);
+	boost::to_lower(str);
+}
+
+bool logger::config_set_log_level(std::string& cfg , LogLevel& level)
+{
+	if(cfg.empty())
+	{
+		level = DEBUG_LEVEL  ;
+		return true ;
+	}
+	else
+	{
+		trim_space_and_lower(cfg);
+		if(cfg == "debug" || cfg =="dbg")
+		{
+			level =	DEBUG_LEVEL;
+		}
+		else if(cfg == "info" || cfg=="infomation")
+		{
+			level = INFO_LEVEL;
+		}
+		else if(cfg == "warn" || cfg=="warning")
+		{
+			level = WARN_LEVEL;
+		}
+		else if(cfg == "err" || cfg =="error")
+		{
+			level = ERR_LEVEL;
+		}
+		else
+		{
+			printf("error:读取 level 错误，不可识别的类型[%s]\r\n" , cfg.c_str() );
+			return false ;
+		}
+	}
+
+	return true ; 
+}
+
+
+//读取可选配置项,保留大小写,节点不存在或为空时返回false
+static bool config_get_text(TiXmlElement* root , const char* name , std::string& value)
+{
+	TiXmlElement* elem = root->FirstChildElement(name);
+	if(elem == NULL || elem->FirstChild() == NULL)
+		return false ;
+
+	value = elem->FirstChild()->Value() ;
+	boost::trim(value);
+	return !value.empty() ;
+}
+
+//读取可选配置项并转成小写
+static bool config_get_optional(TiXmlElement* root , const char* name , std::string& value)
+{
+	if(!config_get_text(root , name , value))
+		return false ;
+	boost::to_lower(value);
+	return true ;
+}
+
+bool logger::config_set_async_options(TiXmlElement* root , async_options& options)
+{
+	std::string transport_str ;
+	if(config_get_optional(root , "transport" , transport_str))
+	{
+		if(transport_str == "locked")
+			options.transport = TRANSPORT_LOCKED ;
+		else if(transport_str == "ring")
+			options.transport = TRANSPORT_THREAD_RING ;
+		else if(transport_str == "mpsc")
+			options.transport = TRANSPORT_MPSC_QUEUE ;
+		else
+		{
+			printf("error:读取 transport 错误，不可识别的类型[%s]\r\n" , transport_str.c_str() );
+			return false ;
+		}
+	}
+
+	//每个线程环形缓冲的大小,单位KB
+	std::string ring_size_str ;
+	if(config_get_optional(root , "ring_size" , ring_size_str))
+	{
+		int ring_kb = atoi(ring_size_str.c_str());
+		if(ring_kb <= 0)
+		{
+			printf("error:读取 ring_size 错误[%s]\r\n" , ring_size_str.c_str() );
+			return false ;
+		}
+		options.ring_size = static_cast<size_t>(ring_kb) * FILE_SIZE_1K ;
+	}
+
+	//前后端之间传递的buffer大小,单位KB
+	std::string buffer_size_str ;
+	if(config_get_optional(root , "buffer_size" , buffer_size_str))
+	{
+		int buffer_kb = atoi(buffer_size_str.c_str());
+		if(buffer_kb <= 0)
+		{
+			printf("error:读取 buffer_size 错误[%s]\r\n" , buffer_size_str.c_str() );
+			return false ;
+		}
+		options.buffer_size = std::max(static_cast<size_t>(buffer_kb) * FILE_SIZE_1K , static_cast<size_t>(kSmallBuffer)) ;
+	}
+
+	//预先分配的buffer个数,至少4个
+	std::string buffer_count_str ;
+	if(config_get_optional(root , "buffer_count" , buffer_count_str))
+	{
+		int count = atoi(buffer_count_str.c_str());
+		if(count <= 0)
+		{
+			printf("error:读取 buffer_count 错误[%s]\r\n" , buffer_count_str.c_str() );
+			return false ;
+		}
+		options.buffer_count = std::max(static_cast<size_t>(count) , kMinPoolBuffers) ;
+	}
+
+	//后台线程积压时的处理方式
+	std::string policy_str ;
+	if(config_get_optional(root , "overflow_policy" , policy_str))
+	{
+		if(policy_str == "drop_newest")
+			options.overflow_policy = OVERFLOW_DROP_NEWEST ;
+		else if(policy_str == "drop_oldest")
+			options.overflow_policy = OVERFLOW_DROP_OLDEST ;
+		else if(policy_str == "block")
+			options.overflow_policy = OVERFLOW_BLOCK ;
+		else if(policy_str == "drop_by_level")
+			options.overflow_policy = OVERFLOW_DROP_BY_LEVEL ;
+		else
+		{
+			printf("error:读取 overflow_policy 错误，不可识别的类型[%s]\r\n" , policy_str.c_str() );
+			return false ;
+		}
+	}
+
+	//block时前端最多等待的时间,单位毫秒
+	std::string block_timeout_str ;
+	if(config_get_optional(root , "block_timeout" , block_timeout_str))
+	{
+		int timeout_ms = atoi(block_timeout_str.c_str());
+		if(timeout_ms < 0)
+		{
+			printf("error:读取 block_timeout 错误[%s]\r\n" , block_timeout_str.c_str() );
+			return false ;
+		}
+		options.block_timeout_ms = timeout_ms ;
+	}
+
+	//locked方式下等待写入的buffer达到这个数时即为积压
+	std::string max_pending_str ;
+	if(config_get_optional(root , "max_pending_buffers" , max_pending_str))
+	{
+		int max_pending = atoi(max_pending_str.c_str());
+		if(max_pending <= 0)
+		{
+			printf("error:读取 max_pending_buffers 错误[%s]\r\n" , max_pending_str.c_str() );
+			return false ;
+		}
+		options.max_pending_buffers = static_cast<size_t>(max_pending) ;
+	}
+
+	//mpsc队列的槽位数,每个槽位可以放一条最长的日志
+	std::string queue_size_str ;
+	if(config_get_optional(root , "queue_size" , queue_size_str))
+	{
+		int slots = atoi(queue_size_str.c_str());
+		if(slots <= 0)
+		{
+			printf("error:读取 queue_size 错误[%s]\r\n" , queue_size_str.c_str() );
+			return false ;
+		}
+		options.queue_slots = static_cast<size_t>(slots) ;
+	}
+
+	//分片数,每个分片有自己的buffer、后台线程和文件
+	std::string shards_str ;
+	if(config_get_optional(root , "shards" , shards_str))
+	{
+		int shards = atoi(shards_str.c_str());
+		if(shards <= 0 || shards > 64)
+		{
+			printf("error:读取 shards 错误[%s]\r\n" , shards_str.c_str() );
+			return false ;
+		}
+		options.shards = static_cast<size_t>(shards) ;
+	}
+
+	std::string shard_by_str ;
+	if(config_get_optional(root , "shard_by" , shard_by_str))
+	{
+		if(shard_by_str == "thread")
+			options.shard_by = SHARD_BY_THREAD ;
+		else if(shard_by_str == "category")
+			options.shard_by = SHARD_BY_CATEGORY ;
+		else
+		{
+			printf("error:读取 shard_by 错误，不可识别的类型[%s]\r\n" , shard_by_str.c_str() );
+			return false ;
+		}
+	}
+
+	//写文件的引擎,uring不可用时自动退回write
+	std::string engine_str ;
+	if(config_get_optional(root , "file_engine" , engine_str))
+	{
+		if(engine_str == "write")
+			options.file.engine = FILE_ENGINE_WRITE ;
+		else if(engine_str == "uring")
+			options.file.engine = FILE_ENGINE_URING ;
+		else if(engine_str == "direct")
+			options.file.engine = FILE_ENGINE_DIRECT ;
+		else if(engine_str == "mmap")
+			options.file.engine = FILE_ENGINE_MMAP ;
+		else if(engine_str == "lz")
+			options.file.engine = FILE_ENGINE_LZ ;
+		else
+		{
+			printf("error:读取 file_engine 错误，不可识别的类型[%s]\r\n" , engine_str.c_str() );
+			return false ;
+		}
+	}
+
+	std::string depth_str ;
+	if(config_get_optional(root , "uring_depth" , depth_str))
+	{
+		int depth = atoi(depth_str.c_str());
+		if(depth <= 0)
 		{
-			buffersToWrite.resize(2);
+			printf("error:读取 uring_depth 错误[%s]\r\n" , depth_str.c_str() );
+			return false ;
 		}
+		options.file.uring_depth = static_cast<size_t>(depth) ;
+	}
 
-		if (!newBuffer1)
+	//uring暂存缓冲区的大小,单位KB
+	std::string uring_buffer_str ;
+	if(config_get_optional(root , "uring_buffer_size" , uring_buffer_str))
+	{
+		int buffer_kb = atoi(uring_buffer_str.c_str());
+		if(buffer_kb <= 0)
 		{
-			assert(!buffersToWrite.empty());
-			newBuffer1 = buffersToWrite.pop_back();
-			newBuffer1->reset_buffer();
+			printf("error:读取 uring_buffer_size 错误[%s]\r\n" , uring_buffer_str.c_str() );
+			return false ;
 		}
+		options.file.uring_buffer_size = static_cast<size_t>(buffer_kb) * FILE_SIZE_1K ;
+	}
 
-		if (!newBuffer2)
+	//O_DIRECT对齐暂存区的大小,单位KB
+	std::string direct_buffer_str ;
+	if(config_get_optional(root , "direct_buffer_size" , direct_buffer_str))
+	{
+		int buffer_kb = atoi(direct_buffer_str.c_str());
+		if(buffer_kb <= 0)
 		{
-			assert(!buffersToWrite.empty());
-			newBuffer2 = buffersToWrite.pop_back();
-			newBuffer2->reset_buffer();
+			printf("error:读取 direct_buffer_size 错误[%s]\r\n" , direct_buffer_str.c_str() );
+			return false ;
 		}
+		options.file.direct_buffer_size = static_cast<size_t>(buffer_kb) * FILE_SIZE_1K ;
+	}
 
-		buffersToWrite.clear();
-		output.flush();
-	}//for
-	output.flush();
-}
-
-
-const char* logLevelStr[NULL_LEVEL] = {
-	"D",
-	"I",
-	"W",
-	"E",
-} ;
-
-void logger::init(const std::string& log_in_dir ,const std::string&basename ,LogLevel level)
-{
-	basename_ =basename ;
-	console_level_ = logfile_level_  =level ;
-	log_dir_ = log_in_dir ;
+	//落盘方式,实际的同步在单独的线程里做
+	std::string durability_str ;
+	if(config_get_optional(root , "durability" , durability_str))
+	{
+		if(durability_str == "none")
+			options.file.durability = DURABILITY_NONE ;
+		else if(durability_str == "periodic")
+			options.file.durability = DURABILITY_PERIODIC ;
+		else if(durability_str == "write_behind")
+			options.file.durability = DURABILITY_WRITE_BEHIND ;
+		else if(durability_str == "on_error")
+			options.file.durability = DURABILITY_ON_ERROR ;
+		else
+		{
+			printf("error:读取 durability 错误，不可识别的类型[%s]\r\n" , durability_str.c_str() );
+			return false ;
+		}
+	}
 
-	bool dir_ok = create_log_dir() ;
-	if(!dir_ok)
-		return;
-	start_logging() ;
+	//periodic的同步间隔,也是其他方式下同步线程最长的等待时间,单位毫秒
+	std::string sync_interval_str ;
+	if(config_get_optional(root , "sync_interval" , sync_interval_str))
+	{
+		int interval_ms = atoi(sync_interval_str.c_str());
+		if(interval_ms <= 0)
+		{
+			printf("error:读取 sync_interval 错误[%s]\r\n" , sync_interval_str.c_str() );
+			return false ;
+		}
+		options.file.sync_interval_ms = interval_ms ;
+	}
 
-}
+	//write_behind每次发起回写的大小,单位KB
+	std::string write_behind_str ;
+	if(config_get_optional(root , "write_behind_size" , write_behind_str))
+	{
+		int behind_kb = atoi(write_behind_str.c_str());
+		if(behind_kb <= 0)
+		{
+			printf("error:读取 write_behind_size 错误[%s]\r\n" , write_behind_str.c_str() );
+			return false ;
+		}
+		options.file.write_behind_size = static_cast<size_t>(behind_kb) * FILE_SIZE_1K ;
+	}
 
-void logger::start_logging()
-{
-	std::string log_full_file_name = log_dir_ + basename_ ; 
+	//滚动掉的文件在后台压缩
+	std::string compress_str ;
+	if(config_get_optional(root , "compress" , compress_str))
+	{
+		if(compress_str == "lz")
+			options.file.compress = true ;
+		else if(compress_str == "none")
+			options.file.compress = false ;
+		else
+		{
+			printf("error:读取 compress 错误，不可识别的类型[%s]\r\n" , compress_str.c_str() );
+			return false ;
+		}
+	}
 
-	logfilePtr_.reset(new async_logging(log_full_file_name));
-	logfilePtr_->start() ; 
-}
+	std::string compress_threads_str ;
+	if(config_get_optional(root , "compress_threads" , compress_threads_str))
+	{
+		int threads = atoi(compress_threads_str.c_str());
+		if(threads <= 0)
+		{
+			printf("error:读取 compress_threads 错误[%s]\r\n" , compress_threads_str.c_str() );
+			return false ;
+		}
+		options.file.compress_threads = threads ;
+	}
 
-bool logger::create_log_dir()
-{
-#ifdef WIN32
-	std::string::size_type pos = 0;
-	std::string::size_type srclen = log_dir_.size();
-	while(std::string::npos != (pos = log_dir_.find('/', pos)))
+	//在后台预先创建下一个文件,滚动时只交换指针
+	std::string precreate_str ;
+	if(config_get_optional(root , "precreate_next" , precreate_str))
 	{
-		log_dir_.replace(pos, 1, "\\");
-		pos += 1;
+		if(precreate_str == "true")
+			options.file.precreate = true ;
+		else if(precreate_str == "false")
+			options.file.precreate = false ;
+		else
+		{
+			printf("error:读取 precreate_next 错误[%s]\r\n" , precreate_str.c_str() );
+			return false ;
+		}
 	}
-	if(log_dir_.at(log_dir_.size()-1)!='\\')
-		log_dir_+="\\" ; 
 
-	BOOL result = MakeSureDirectoryPathExists(log_dir_.c_str());
-	if(result == FALSE)
+	std::string fdatasync_str ;
+	if(config_get_optional(root , "uring_fdatasync" , fdatasync_str))
 	{
-		printf("MakeSureDirectoryPathExists error:[%s]\r\n" ,log_dir_.c_str() );
+		if(fdatasync_str == "true")
+			options.file.uring_fdatasync = true ;
+		else if(fdatasync_str == "false")
+			options.file.uring_fdatasync = false ;
+		else
+		{
+			printf("error:读取 uring_fdatasync 错误[%s]\r\n" , fdatasync_str.c_str() );
+			return false ;
+		}
 	}
-	return result ;
-#else
-#error not support
-#endif
+
+	return true ;
 }
 
 
-void logger::log(LogLevel level ,const char *logstr, ... )
+//log_dst以外的输出目的,每个<sink>一个:
+//<sink><type>tcp</type><level>info</level><address>127.0.0.1:5140</address></sink>
+bool logger::config_set_sinks(TiXmlElement* root , std::vector<sink_options>& sinks)
 {
-	if( (level<console_level_)
-		&&(level<logfile_level_))
-		return ; 
-
-
-	char buffer[MAX_LOG_BUFFER_SIZE] ; 
-
-	SYSTEMTIME curST ;
-	::GetLocalTime(&curST);
-
-	sprintf_s(buffer ,MAX_LOG_BUFFER_SIZE ,"%04d-%02d-%02d %02d:%02d:%02d.%03d,%s," ,
-		curST.wYear , curST.wMonth ,curST.wDay ,curST.wHour ,curST.wMinute ,curST.wSecond ,
-		curST.wMilliseconds , logLevelStr[level]) ;
-	int head_len = strlen(buffer);
+	sinks.clear();
+	for(TiXmlElement* elem = root->FirstChildElement("sink"); elem != NULL; elem = elem->NextSiblingElement("sink"))
+	{
+		sink_options options ;
+		if(!config_get_optional(elem , "type" , options.type))
+		{
+			printf("error:读取 sink type 错误\r\n");
+			return false ;
+		}
 
-	va_list args;
-	int     len;
-	va_start( args, logstr );
+		options.name = options.type ;
+		config_get_text(elem , "name" , options.name);
 
-	len = _vscprintf( logstr, args ) + 1; 
-	if(len>(MAX_LOG_BUFFER_SIZE - head_len-2))
-		return ;
-	vsprintf( &buffer[head_len], logstr, args ); 
+		std::string level_str ;
+		if(config_get_optional(elem , "level" , level_str) && !config_set_log_level(level_str , options.level))
+			return false ;
 
-	strcat(buffer ,"\r\n");
+		if(!config_set_record_format(elem , "format" , options.format))
+			return false ;
 
-	if(is_console_log)
-		console_output( level , buffer , head_len + len +2 ); //̨
+		//排队等待写出的最多条数,超过时丢弃
+		std::string queue_size_str ;
+		if(config_get_optional(elem , "queue_size" , queue_size_str))
+		{
+			int records = atoi(queue_size_str.c_str());
+			if(records <= 0)
+			{
+				printf("error:读取 sink queue_size 错误[%s]\r\n" , queue_size_str.c_str() );
+				return false ;
+			}
+			options.queue_size = static_cast<size_t>(records) ;
+		}
 
-	if(is_file_log)
-		logfile_output(level,buffer , head_len + len +2 );	 //ļ׷
+		if(options.type == "memory")
+		{
+			//内存中保留的条数
+			std::string records_str ;
+			if(config_get_optional(elem , "records" , records_str))
+			{
+				int records = atoi(records_str.c_str());
+				if(records <= 0)
+				{
+					printf("error:读取 sink records 错误[%s]\r\n" , records_str.c_str() );
+					return false ;
+				}
+				options.records = static_cast<size_t>(records) ;
+			}
+		}
+#ifndef WIN32
+		else if(options.type == "unix_dgram")
+		{
+			if(!config_get_text(elem , "path" , options.path))
+			{
+				printf("error:读取 sink path 错误\r\n");
+				return false ;
+			}
+		}
+		else if(options.type == "tcp")
+		{
+			//host:port,IPv6地址写成[::1]:port
+			std::string address_str ;
+			std::string::size_type colon = std::string::npos ;
+			if(config_get_text(elem , "address" , address_str))
+				colon = address_str.rfind(':');
+			if(colon == std::string::npos || colon == 0 || colon + 1 == address_str.size())
+			{
+				printf("error:读取 sink address 错误[%s]\r\n" , address_str.c_str() );
+				return false ;
+			}
+			options.host = address_str.substr(0 , colon);
+			if(options.host.size() > 2 && options.host[0] == '[' && options.host[options.host.size() - 1] == ']')
+				options.host = options.host.substr(1 , options.host.size() - 2);
+			options.port = address_str.substr(colon + 1);
+		}
+#endif
+		else
+		{
+			printf("error:读取 sink type 错误，不可识别的类型[%s]\r\n" , options.type.c_str() );
+			return false ;
+		}
+		sinks.push_back(options);
+	}
+	return true ;
 }
 
-void logger::console_output(LogLevel level , const char* buffer , int len )
-{
-	if(level < console_level_)
-		return ;
 
-	printf(buffer);
-
-}
-void logger::logfile_output(LogLevel level , const char* buffer , int len)
+//按分类的级别,没有配置的分类继承上一级:
+//<category><name>net.reactor</name><level>debug</level></category>,name为root时即最上一级
+bool logger::config_set_categories(TiXmlElement* root , std::vector<std::pair<std::string , LogLevel> >& categories)
 {
-	if(level < logfile_level_)
-		return ;
-
-	if(logfilePtr_)
-		logfilePtr_->append(buffer , len-1  );
+	categories.clear();
+	for(TiXmlElement* elem = root->FirstChildElement("category"); elem != NULL; elem = elem->NextSiblingElement("category"))
+	{
+		std::string name_str ;
+		std::string level_str ;
+		if(!config_get_text(elem , "name" , name_str) || !config_get_optional(elem , "level" , level_str))
+		{
+			printf("error:读取 category 错误,name和level都不能为空\r\n");
+			return false ;
+		}
+		LogLevel level ;
+		if(!config_set_log_level(level_str , level))
+			return false ;
+		if(name_str == "root")
+			name_str.clear();
+		categories.push_back(std::make_pair(name_str , level));
+	}
+	return true ;
 }
 
-static void trim_space_and_lower(std::string& str)
-{
-	boost::trim(str);
-	boost::to_lower(str);
-}
 
-bool logger::config_set_log_level(std::string& cfg , LogLevel& level)
+//控制台输出的写线程:<console_color>按级别加颜色,<console_nonblock>读端来不及读时丢弃
+bool logger::config_set_console(TiXmlElement* root , console_options& options)
 {
-	if(cfg.empty())
-	{
-		level = DEBUG_LEVEL  ;
-		return true ;
-	}
-	else
+	std::string color_str ;
+	if(config_get_optional(root , "console_color" , color_str))
 	{
-		trim_space_and_lower(cfg);
-		if(cfg == "debug" || cfg =="dbg")
+		if(color_str == "false")
+			options.color = CONSOLE_COLOR_OFF ;
+		else if(color_str == "true")
+			options.color = CONSOLE_COLOR_ON ;
+		else if(color_str == "auto")
+			options.color = CONSOLE_COLOR_AUTO ;
+		else
 		{
-			level =	DEBUG_LEVEL;
+			printf("error:读取 console_color 错误[%s]\r\n" , color_str.c_str() );
+			return false ;
 		}
-		else if(cfg == "info" || cfg=="infomation")
+	}
+
+	std::string nonblock_str ;
+	if(config_get_optional(root , "console_nonblock" , nonblock_str))
+	{
+		if(nonblock_str == "true")
+			options.nonblock = true ;
+		else if(nonblock_str == "false")
+			options.nonblock = false ;
+		else
 		{
-			level = INFO_LEVEL;
+			printf("error:读取 console_nonblock 错误[%s]\r\n" , nonblock_str.c_str() );
+			return false ;
 		}
-		else if(cfg == "warn" || cfg=="warning")
+	}
+
+	std::string queue_size_str ;
+	if(config_get_optional(root , "console_queue_size" , queue_size_str))
+	{
+		int records = atoi(queue_size_str.c_str());
+		if(records <= 0)
 		{
-			level = WARN_LEVEL;
+			printf("error:读取 console_queue_size 错误[%s]\r\n" , queue_size_str.c_str() );
+			return false ;
 		}
-		else if(cfg == "err" || cfg =="error")
+		options.queue_size = static_cast<size_t>(records) ;
+	}
+	return true ;
+}
+
+
+//<watch_config>true</watch_config>时监视配置文件,变化后重新加载;
+//<watch_interval>为检查文件的间隔毫秒数,inotify不可用时靠它发现变化
+bool logger::config_set_watch(TiXmlElement* root , logger_settings& settings)
+{
+	std::string watch_str ;
+	if(config_get_optional(root , "watch_config" , watch_str))
+	{
+		if(watch_str == "true")
+			settings.watch = true ;
+		else if(watch_str == "false")
+			settings.watch = false ;
+		else
 		{
-			level = ERR_LEVEL;
+			printf("error:读取 watch_config 错误[%s]\r\n" , watch_str.c_str() );
+			return false ;
 		}
-		else
+	}
+
+	std::string interval_str ;
+	if(config_get_optional(root , "watch_interval" , interval_str))
+	{
+		int interval = atoi(interval_str.c_str());
+		if(interval <= 0)
 		{
-			printf("error:ȡ level 󣬲ʶ[%s]\r\n" , cfg.c_str() );
+			printf("error:读取 watch_interval 错误[%s]\r\n" , interval_str.c_str() );
 			return false ;
 		}
+		settings.watch_interval_ms = interval ;
 	}
+	return true ;
+}
 
-	return true ; 
+
+bool logger::config_set_time_precision(TiXmlElement* root , TimePrecision& precision)
+{
+	std::string precision_str ;
+	if(!config_get_optional(root , "time_precision" , precision_str))
+		return true ;
+
+	if(precision_str == "ms")
+		precision = TIME_PRECISION_MS ;
+	else if(precision_str == "us")
+		precision = TIME_PRECISION_US ;
+	else if(precision_str == "ns")
+		precision = TIME_PRECISION_NS ;
+	else
+	{
+		printf("error:读取 time_precision 错误，不可识别的类型[%s]\r\n" , precision_str.c_str() );
+		return false ;
+	}
+	return true ;
+}
+
+
+//sink收到的记录格式:text、json或logfmt
+bool logger::config_set_record_format(TiXmlElement* root , const char* name , RecordFormat& format)
+{
+	std::string format_str ;
+	if(!config_get_optional(root , name , format_str))
+		return true ;
+
+	if(format_str == "text")
+		format = FORMAT_TEXT ;
+	else if(format_str == "json")
+		format = FORMAT_JSON ;
+	else if(format_str == "logfmt")
+		format = FORMAT_LOGFMT ;
+	else
+	{
+		printf("error:读取 %s 错误，不可识别的类型[%s]\r\n" , name , format_str.c_str() );
+		return false ;
+	}
+	return true ;
+}
+
+bool logger::config_set_format_mode(TiXmlElement* root , bool& deferred)
+{
+	std::string mode_str ;
+	if(!config_get_optional(root , "format_mode" , mode_str))
+		return true ;
+
+	if(mode_str == "text")
+		deferred = false ;
+	else if(mode_str == "deferred")
+	{
+#ifdef FILELOGGER_HAS_CXX11
+		deferred = true ;
+#else
+		printf("warning:format_mode deferred 需要C++11,使用text\r\n");
+		deferred = false ;
+#endif
+	}
+	else
+	{
+		printf("error:读取 format_mode 错误，不可识别的类型[%s]\r\n" , mode_str.c_str() );
+		return false ;
+	}
+	return true ;
 }
 
 
 #define  INNER_DEBUG	
 
-bool logger::load_config(const std::string& filename)
+//只读取配置,不改变正在使用的输出
+bool logger::parse_config(const std::string& filename , logger_settings& settings)
 {    
 	boost::scoped_ptr<TiXmlDocument> config_document( new TiXmlDocument(filename.c_str()));
 	assert(config_document && "config_document == NULL");
@@ -498,7 +2660,12 @@ bool logger::load_config(const std::string& filename)
 		printf("error: load log config file failed!\r\n");
 		return false ; 
 	}
-	config_document->LoadFile();
+	//重新加载时可能读到写了一半的文件,解析出错就不用它
+	if(!config_document->LoadFile())
+	{
+		printf("error:解析 %s 失败[%s]\r\n" , filename.c_str() , config_document->ErrorDesc() );
+		return false ;
+	}
 
 	TiXmlElement *RootElement = config_document->RootElement(); //log_config
 	if(RootElement == NULL)
@@ -514,7 +2681,7 @@ bool logger::load_config(const std::string& filename)
 		return false;
 	}
 
-	//ȡlog_dst
+	//读取log_dst配置
 	TiXmlElement*  log_dst_elem = RootElement->FirstChildElement("log_dst");
 	if(log_dst_elem == NULL)
 	{
@@ -524,9 +2691,9 @@ bool logger::load_config(const std::string& filename)
 	std::string log_dst_str = log_dst_elem->FirstChild()->Value() ;
 	if(log_dst_str.empty())
 	{
-		//losg_dstûãĬȫ
-		is_console_log = false;
-		is_file_log = false;
+		//losg_dst没有设置，则默认全部不输出
+		settings.console = false;
+		settings.file = false;
 	}
 	else
 	{
@@ -538,27 +2705,27 @@ bool logger::load_config(const std::string& filename)
 
 		if(log_dst_str == "console")
 		{
-			is_console_log = true;
-			is_file_log = false;
+			settings.console = true;
+			settings.file = false;
 		}
 		else if(log_dst_str == "file")
 		{
-			is_console_log = false;
-			is_file_log = true;
+			settings.console = false;
+			settings.file = true;
 		}
 		else if(log_dst_str == "both")
 		{
-			is_console_log = true;
-			is_file_log = true;
+			settings.console = true;
+			settings.file = true;
 		}
 		else
 		{
-			is_console_log = false;
-			is_file_log = false;
+			settings.console = false;
+			settings.file = false;
 		}
 	}
 
-	//ȡconsole_level
+	//读取console_level配置
 	TiXmlElement* console_level_elem = RootElement->FirstChildElement("console_level");
 	if(console_level_elem == NULL)
 	{
@@ -567,11 +2734,11 @@ bool logger::load_config(const std::string& filename)
 	}
 	std::string console_level_str = console_level_elem->FirstChild()->Value() ;
 
-	bool set_result =config_set_log_level(console_level_str , console_level_);
+	bool set_result =config_set_log_level(console_level_str , settings.console_level);
 	if(!set_result)
 		return false ; 
 
-	//ȡfile_level
+	//读取file_level配置
 	TiXmlElement* file_level_elem = RootElement->FirstChildElement("file_level");
 	if(file_level_elem == NULL)
 	{
@@ -580,11 +2747,11 @@ bool logger::load_config(const std::string& filename)
 	}
 	std::string file_level_str = file_level_elem->FirstChild()->Value() ;
 
-	set_result =config_set_log_level(file_level_str , logfile_level_);
+	set_result =config_set_log_level(file_level_str , settings.file_level);
 	if(!set_result)
 		return false ; 
 
-	//ȡlog_dir
+	//读取log_dir配置
 	TiXmlElement* log_dir_elem = RootElement->FirstChildElement("log_dir");
 	if(log_dir_elem == NULL)
 	{
@@ -597,7 +2764,7 @@ bool logger::load_config(const std::string& filename)
 	printf("log_dir:[%s]\r\n" ,log_dir_str.c_str() );
 #endif
 
-	//ȡbasename
+	//读取basename配置
 	TiXmlElement* basename_elem = RootElement->FirstChildElement("basename");
 	if(basename_elem == NULL)
 	{
@@ -610,21 +2777,132 @@ bool logger::load_config(const std::string& filename)
 	printf("basename:[%s]\r\n" ,basename_str.c_str() );
 #endif
 
-	basename_ =basename_str ;
-	log_dir_ = log_dir_str ;
+	//读取前端传递方式等可选配置
+	if(!config_set_async_options(RootElement , settings.async))
+		return false ;
+
+	if(!config_set_time_precision(RootElement , settings.async.time_precision))
+		return false ;
+
+	if(!config_set_format_mode(RootElement , settings.async.deferred))
+		return false ;
+
+	if(!config_set_console(RootElement , settings.console_output))
+		return false ;
+
+	if(!config_set_record_format(RootElement , "console_format" , settings.console_format))
+		return false ;
+
+	if(!config_set_record_format(RootElement , "file_format" , settings.file_format))
+		return false ;
+
+	if(!config_set_sinks(RootElement , settings.sinks))
+		return false ;
+
+	if(!config_set_categories(RootElement , settings.categories))
+		return false ;
 
-	assert(!basename_.empty());
-	assert(!log_dir_.empty());
-	bool dir_ok = create_log_dir() ;
-	if(!dir_ok)
+	if(!config_set_watch(RootElement , settings))
 		return false ;
 
-	start_logging() ;
+	settings.basename =basename_str ;
+	settings.log_dir = log_dir_str ;
+
+	assert(!settings.basename.empty());
+	assert(!settings.log_dir.empty());
 	return true ; 
 }
 
+bool logger::load_config(const std::string& filename)
+{
+	logger_settings settings ;
+	if(!parse_config(filename , settings))
+		return false ;
+
+	logger_snapshot* retired = NULL ;
+	{
+		boost::mutex::scoped_lock lock(config_mutex_);
+		if(!apply_settings_locked(settings , &retired))
+			return false ;
+		config_file_ = filename ;
+
+		//是否监视以第一次加载的为准,重新加载不会启动或停止它
+		if(settings.watch && !watcher_)
+		{
+			watcher_.reset(new config_watcher(filename , settings.watch_interval_ms ,
+				boost::bind(&logger::reload , this)));
+			watcher_->start();
+		}
+	}
+	retire_snapshot(retired);
+	return true ;
+}
+
+//在监视线程里调用,读取和解析时不持有锁,日志照常写
+bool logger::reload()
+{
+	std::string filename ;
+	{
+		boost::mutex::scoped_lock lock(config_mutex_);
+		filename = config_file_ ;
+	}
+	if(filename.empty())
+		return false ;
+
+	logger_settings settings ;
+	if(!parse_config(filename , settings))
+	{
+		printf("error:重新加载 %s 失败,继续使用原来的配置\r\n" , filename.c_str() );
+		return false ;
+	}
+
+	logger_snapshot* retired = NULL ;
+	{
+		boost::mutex::scoped_lock lock(config_mutex_);
+		if(!apply_settings_locked(settings , &retired))
+		{
+			printf("error:重新加载 %s 失败,继续使用原来的配置\r\n" , filename.c_str() );
+			return false ;
+		}
+	}
+	retire_snapshot(retired);
+	return true ;
+}
+
+void logger::get_overflow_stats(overflow_stats* stats)
+{
+	rcu_read_guard guard(rcu_);
+	file_sink* file = snapshot_.load(boost::memory_order_acquire)->file ;
+	if(file)
+		file->get_overflow_stats(stats);
+	else
+		memset(stats , 0 , sizeof(*stats));
+}
+
+void logger::get_stats(async_logging_stats* stats)
+{
+	rcu_read_guard guard(rcu_);
+	file_sink* file = snapshot_.load(boost::memory_order_acquire)->file ;
+	if(file)
+		file->get_logging_stats(stats);
+	else
+		memset(stats , 0 , sizeof(*stats));
+}
+
+//写完已经接收的日志。之后再加载配置时重新创建各个sink
 void logger::stop()
 {
-if(logfilePtr_)
-logfilePtr_->stop();
+	//监视线程可能正在等config_mutex_,在锁外停止它
+	boost::scoped_ptr<config_watcher> watcher ;
+	{
+		boost::mutex::scoped_lock lock(config_mutex_);
+		watcher.swap(watcher_);
+	}
+	watcher.reset();
+
+	boost::mutex::scoped_lock lock(config_mutex_);
+	const logger_snapshot& snapshot = *snapshot_.load(boost::memory_order_relaxed);
+	for(size_t i = 0; i < snapshot.sinks.size(); ++i)
+		snapshot.sinks[i].sink->stop();
+	stopped_ = true ;
 }
\ No newline at end of file
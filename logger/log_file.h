@@ -7,7 +7,7 @@ file base:	log_file
 file ext:	h
 author:		
 
-purpose:	첽־¼Ҫ㷨οmuduo
+purpose:	异步日志记录（主要算法参考muduo）
 
 License:
 
@@ -45,15 +45,44 @@ License:
 #define __LOG_FILE_INCLUDE__
 
 #include <stdio.h>
+#include <stdarg.h>
 #include <string>
+#include <vector>
+#include <utility>
 #include <boost/utility.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
+#include <boost/ptr_container/ptr_map.hpp>
 #include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/atomic.hpp>
+#ifdef WIN32
 #include <windows.h>
+#else
+#include <unistd.h>
+#include <sys/time.h>
+#endif
 #include "threadctrl/threadctrl.h"
 #include "threadctrl/threadctrl_ext.h"
 #include "singleton.h"
+#include "spsc_ring.h"
+#include "mpsc_queue.h"
+#include "log_time.h"
+#include "log_format.h"
+#include "log_deferred.h"
+#include "log_stats.h"
+#include "file_engine.h"
+#include "log_sync.h"
+#include "log_precreate.h"
+#include "log_compress.h"
+#include "log_sink.h"
+#include "log_category.h"
+#include "log_kv.h"
+#include "log_rcu.h"
+#include "log_watch.h"
+
+class TiXmlElement ;
 
 
 #define  FILE_SIZE_1K		(1024)
@@ -63,18 +92,30 @@ License:
 namespace fst_log_file
 {
 
-	class fast_file : boost::noncopyable
+	class fast_file : public file_engine
 	{
 	public:
 		explicit fast_file(const std::string& filename);
 		~fast_file();
 		void append(const char* logline, const size_t len);
+#ifndef WIN32
+		void append_batch(const log_iovec* vec, int count);
+#endif
 		void flush();
 		size_t writtenBytes() const { return writtenBytes_; }
+		int native_fd() const ;
+#ifndef WIN32
+		void preallocate(size_t bytes);
+#endif
 
 	private:
 		size_t write(const char* logline, size_t len) ;
+#ifdef WIN32
 		FILE* fp_;
+#else
+		int fd_;
+		bool preallocated_;
+#endif
 		size_t writtenBytes_;
 	};
 
@@ -86,15 +127,27 @@ namespace fst_log_file
 			size_t rollSize = 4*FILE_SIZE_1M,
 			int checkEveryN = 20,
 			bool threadSafe = true ,
-			int flushInterval = 2);
+			int flushInterval = 2,
+			const file_options& options = file_options());
 		~log_file();
 
 		void append(const char* logline, int len);
+		//一次写入一批buffer,按buffer粒度滚动文件,一个buffer不会被拆到两个文件
+		void append_batch(const log_iovec* vec, int count);
 		void flush();
+		//DURABILITY_ON_ERROR下请求同步线程把已写入的数据落盘,不等待
+		void request_sync();
+		//写完并关闭当前文件,之后不能再append;wait_compress为false时不等滚动掉的文件压完,
+		//压缩线程在后台压完队列后自行退出
+		void close(bool wait_compress = true);
+		void get_stats(log_file_stats* stats) const;
 
 		static 	std::string getLogFileName(const std::string& basename, time_t* now) ;
 	private:
 		void append_unlocked(const char* logline, int len);
+		void append_batch_unlocked(const log_iovec* vec, int count);
+		void after_append_unlocked(int appended);
+		void flush_unlocked();
 		bool rollFile() ;
 
 		const std::string basename_;
@@ -106,8 +159,21 @@ namespace fst_log_file
 		size_t rollSize_ ; 
 		int count_ ; 
 		int checkEveryN_ ; 
-		boost::scoped_ptr<fast_file> file_;
+		file_options options_;
+		//声明在file_之前,析构时先关闭文件再做最后一次同步
+		boost::scoped_ptr<log_syncer> syncer_;
+		log_compressor_ptr compressor_;
+		boost::scoped_ptr<file_precreator> precreator_;	//会调用compressor_,声明在它之后
+		file_engine_ptr file_;
+		std::string filename_;
 		const static int kRollPerSeconds_ = 60*60*24;
+
+		stat_counter bytes_written_;
+		stat_counter rolls_;
+		stat_counter precreated_rolls_;
+		latency_histogram write_latency_;
+		latency_histogram flush_latency_;
+		latency_histogram roll_latency_;
 	};
 
 
@@ -146,29 +212,271 @@ namespace fst_log_file
 		char* cur_;
 	};
 
-	//ÿ־ֽ
+	//大小在运行时确定的buffer,由async_logging的缓冲池预先分配并循环使用
+	class LogBuffer : boost::noncopyable
+	{
+	public:
+		explicit LogBuffer(size_t size)
+			: data_(new char[size]), end_(data_ + size), cur_(data_), records_(0)
+		{
+			clear_levels();
+		}
+
+		~LogBuffer(){ delete [] data_; }
+
+		//每次append或add都是一条完整的记录,同时按级别计数
+		void append(const char*  buf, size_t len, LogLevel level){
+			if ((size_t)avail() > len){
+				memcpy(cur_, buf, len);
+				add(len, level);
+			}
+		}
+		const char* data() const { return data_; }
+		int length() const { return static_cast<int>(cur_ - data_); }
+		int records() const { return records_; }
+		int records(LogLevel level) const { return level_records_[level]; }
+		int bytes(LogLevel level) const { return level_bytes_[level]; }
+
+		char* current() { return cur_; }
+		int avail() const { return static_cast<int>(end_ - cur_); }
+		void add(size_t len, LogLevel level)
+		{
+			cur_ += len;
+			++records_;
+			++level_records_[level];
+			level_bytes_[level] += static_cast<int>(len);
+		}
+
+		void reset_buffer() { cur_ = data_; records_ = 0; clear_levels(); }
+		void bzero() { ::memset(data_,  0 , end_ - data_ ) ; }
+
+	private:
+		void clear_levels()
+		{
+			::memset(level_records_, 0, sizeof level_records_);
+			::memset(level_bytes_, 0, sizeof level_bytes_);
+		}
+
+		char* const data_;
+		const char* const end_;
+		char* cur_;
+		int records_;
+		int level_records_[NULL_LEVEL];
+		int level_bytes_[NULL_LEVEL];
+	};
+
+	//每条日志的最大字节数
 	#define  MAX_LOG_BUFFER_SIZE	(512)
 
+	//日志行结束符
+#ifdef WIN32
+	#define  LOG_EOL	"\r\n"
+#else
+	#define  LOG_EOL	"\n"
+#endif
+
+	//线程局部存储
+#ifdef _MSC_VER
+	#define  LOG_THREAD_LOCAL	__declspec(thread)
+#else
+	#define  LOG_THREAD_LOCAL	__thread
+#endif
+
+	//各个sink中最低的级别,低于它的日志在宏里直接跳过,
+	//不求值参数也不访问单例。未初始化时为DEBUG_LEVEL,全部交给logger判断
+	extern boost::atomic<int> g_log_level_threshold ;
+
+	inline bool log_level_enabled(LogLevel level)
+	{
+		return level >= g_log_level_threshold.load(boost::memory_order_relaxed);
+	}
+
+	//前端日志交给后台线程的方式
+	enum LogTransport
+	{
+		TRANSPORT_LOCKED = 0,	//所有线程加锁写同一个buffer
+		TRANSPORT_THREAD_RING,	//每个线程一个无锁环形缓冲,后台线程轮流取
+		TRANSPORT_MPSC_QUEUE,	//所有线程共用一个有界无锁队列,每条记录一个槽位
+	};
+
+	//后台线程来不及写时前端的处理方式
+	enum OverflowPolicy
+	{
+		OVERFLOW_DROP_NEWEST = 0,	//丢弃当前这条
+		OVERFLOW_DROP_OLDEST,		//丢弃最早的一个待写buffer,无锁传递方式下同DROP_NEWEST
+		OVERFLOW_BLOCK,				//最多等待block_timeout_ms,仍然没有空间时丢弃当前这条
+		OVERFLOW_DROP_BY_LEVEL,		//WARN及以上一直等到有空间为止,其余丢弃当前这条
+	};
+
+	//分片写文件时记录分到哪个分片
+	enum ShardBy
+	{
+		SHARD_BY_THREAD = 0,	//同一线程的记录在同一个分片里,保持线程内的顺序
+		SHARD_BY_CATEGORY,		//按分类,不带分类的记录仍按线程
+	};
+
+	//因为积压而丢弃的日志
+	struct overflow_stats
+	{
+		boost::uint64_t dropped_records ;
+		boost::uint64_t dropped_bytes ;
+		boost::uint64_t blocked ;		//因为积压等待过、最终写入成功的条数
+	};
+
+	struct level_stats
+	{
+		boost::uint64_t records ;
+		boost::uint64_t bytes ;
+	};
+
+	//async_logging的运行统计,各前端线程的计数在读取时才合并
+	struct async_logging_stats
+	{
+		level_stats accepted[NULL_LEVEL] ;	//进入传递队列的,不包括当场丢弃的
+		level_stats written[NULL_LEVEL] ;	//后台线程写入文件的
+		level_stats dropped[NULL_LEVEL] ;	//因为积压丢弃的,包括drop_oldest丢弃的已接收记录
+		boost::uint64_t evicted ;			//drop_oldest丢弃的已接收记录数
+		boost::uint64_t blocked ;			//因为积压等待过、最终写入成功的条数
+		boost::uint64_t queue_depth ;		//已进入队列、后台线程还没有取走的条数
+		boost::uint64_t queue_high_water ;	//后台线程一次取走的最多条数
+		boost::uint64_t buffer_swaps ;		//交给后台线程写入的buffer数
+		boost::uint64_t swaps_per_sec ;		//上一个整秒内的buffer_swaps
+		histogram_snapshot lock_wait ;		//TRANSPORT_LOCKED下前端等锁的耗时,没有竞争时不计
+		log_file_stats file ;
+	};
+
+	struct async_options
+	{
+		async_options()
+			:transport(TRANSPORT_LOCKED)
+			,ring_size(64*FILE_SIZE_1K)
+			,queue_slots(4096)
+			,buffer_size(kSmallBuffer)
+			,buffer_count(4)
+			,max_pending_buffers(25)
+			,overflow_policy(OVERFLOW_DROP_NEWEST)
+			,block_timeout_ms(100)
+			,deferred(false)
+			,time_precision(TIME_PRECISION_MS)
+			,shards(1)
+			,shard_by(SHARD_BY_THREAD)
+		{}
+
+		LogTransport transport ;
+		size_t ring_size ;		//TRANSPORT_THREAD_RING下每个线程环形缓冲的字节数
+		size_t queue_slots ;	//TRANSPORT_MPSC_QUEUE下队列的槽位数
+		size_t buffer_size ;	//前后端之间传递的每个buffer的字节数
+		size_t buffer_count ;	//预先分配的buffer个数,用完后才会再分配
+		size_t max_pending_buffers ;	//TRANSPORT_LOCKED下等待写入的buffer达到这个数即为积压
+		OverflowPolicy overflow_policy ;
+		int block_timeout_ms ;	//OVERFLOW_BLOCK下前端最多等待的毫秒数
+		bool deferred ;			//buffer中是deferred_header记录,写文件前由后台线程格式化
+		TimePrecision time_precision ;	//延迟格式化时时间戳的精度
+		file_options file ;		//后台线程写文件使用的引擎
+		size_t shards ;			//大于1时分成多个async_logging,各自的buffer、后台线程和文件
+		ShardBy shard_by ;
+	};
+
+	//分片时在文本中插入的序号字段的最大字节数:"seq":、20位数字和分隔符
+	#define  MAX_LOG_SEQUENCE_SIZE	(32)
+	//加上序号后一条文本记录的最大字节数
+	#define  MAX_LOG_TEXT_SIZE		(MAX_LOG_BUFFER_SIZE + MAX_LOG_SEQUENCE_SIZE)
+	//进入async_logging的一条记录的最大字节数
+	#define  MAX_LOG_RECORD_SIZE	(MAX_LOG_TEXT_SIZE + sizeof(fst_log_file::deferred_header))
+
 	class async_logging : boost::noncopyable
 	{
 	public:
-		async_logging(const std::string& basename,int flushInterval = 2);
+		async_logging(const std::string& basename,int flushInterval = 2 ,
+			const async_options& options = async_options());
 		~async_logging();
 
-		void append(const char* logline, int len);
+		void append(const char* logline, int len, LogLevel level);
 		void start();
 		void stop();
+		void get_overflow_stats(overflow_stats* stats);
+		void get_stats(async_logging_stats* stats);
+		//后台线程写完已经取走的buffer后关闭当前文件,之后写到basename
+		void reopen(const std::string& basename);
+		//文件记录的格式,丢弃通知按它编码
+		void set_record_format(RecordFormat format) { record_format_.store(format , boost::memory_order_relaxed); }
 
 	private:
 		async_logging(const async_logging&);  // ptr_container
 		async_logging& operator=(const async_logging&);  // ptr_container
 
-		void threadFunc();
-	
-		typedef FixedBuffer<kSmallBuffer> Buffer;
+		typedef LogBuffer Buffer;
 		typedef boost::ptr_vector<Buffer> BufferVector;
 		typedef BufferVector::auto_type BufferPtr;
 
+		//每个前端线程一份,计数只由该线程写,读取统计时合并
+		struct producer : boost::noncopyable
+		{
+			producer() : retired(false) {}
+
+			void accepted(LogLevel level , int len)
+			{
+				accepted_records[level].add(1);
+				accepted_bytes[level].add(len);
+			}
+			void dropped(LogLevel level , int len)
+			{
+				dropped_records[level].add(1);
+				dropped_bytes[level].add(len);
+			}
+			void evicted(const LogBuffer& buffer);
+
+			stat_counter accepted_records[NULL_LEVEL];
+			stat_counter accepted_bytes[NULL_LEVEL];
+			stat_counter dropped_records[NULL_LEVEL];
+			stat_counter dropped_bytes[NULL_LEVEL];
+			stat_counter evicted_records;
+			stat_counter blocked;
+			latency_histogram lock_wait;
+			boost::scoped_ptr<spsc_ring> ring;	//只有TRANSPORT_THREAD_RING才有
+			boost::atomic<bool> retired;		//线程已经退出
+		};
+		typedef boost::shared_ptr<producer> ProducerPtr;
+
+		//线程退出时由thread_specific_ptr析构,后台线程取空环形缓冲后回收
+		struct producer_holder
+		{
+			explicit producer_holder(const ProducerPtr& p) : self(p) {}
+			~producer_holder() { self->retired.store(true, boost::memory_order_release); }
+			ProducerPtr self ;
+		};
+
+		void threadFunc();
+		void reopen_output();
+		void write_generation(log_file& output , BufferVector& buffersToWrite ,
+			BufferPtr& newBuffer1 , BufferPtr& newBuffer2);
+
+		typedef FixedBuffer<kLargeBuffer> RenderBuffer;
+		void render_deferred(log_file& output , const Buffer& buffer , RenderBuffer& staging);
+
+		void append_locked(producer* self , const char* logline, int len, LogLevel level);
+		void append_ring(producer* self , const char* logline, int len, LogLevel level);
+		void append_queue(producer* self , const char* logline, int len, LogLevel level);
+		bool wait_locked(producer* self , LogLevel level);
+		bool keep_waiting(LogLevel level , const log_timestamp& deadline);
+		log_timestamp block_deadline() const;
+		void report_dropped(log_file& output);
+		void count_written(const BufferVector& buffers);
+		producer* this_producer();
+		void reap_producers_locked();
+		static void merge_producer(const producer& p , async_logging_stats* stats);
+		void wakeup();
+		void wait_lock_free();
+		bool drain_lock_free(BufferPtr& current , BufferPtr& spare , BufferVector& buffersToWrite);
+		bool drain_rings(BufferPtr& current , BufferPtr& spare , BufferVector& buffersToWrite);
+		bool drain_queue(BufferPtr& current , BufferPtr& spare , BufferVector& buffersToWrite);
+		bool reserve_buffer(BufferPtr& current , BufferPtr& spare , BufferVector& buffersToWrite , int len);
+		bool has_pending();
+		void take_buffer_locked(BufferPtr& buffer);
+		void recycle_buffers(BufferVector& buffers);
+
+		const async_options options_;
+		const unsigned long id_;
 		const int flushInterval_;
 		volatile bool running_;
 		std::string basename_;
@@ -177,51 +485,331 @@ namespace fst_log_file
 		BufferPtr currentBuffer_;
 		BufferPtr nextBuffer_;
 		BufferVector buffers_;
+		BufferVector free_buffers_;		//空闲的buffer,由mutex_保护
 		countdown_latch latch_ ; 
 		boost::thread* log_thread ; 
+
+		boost::thread_specific_ptr<producer_holder> producer_holder_;
+		void* producers_mutex_ ;
+		std::vector<ProducerPtr> producers_;
+		async_logging_stats retired_stats_;	//已经回收的前端线程的计数,由producers_mutex_保护
+		size_t ring_cursor_;
+		boost::scoped_ptr<mpsc_queue> queue_;
+		boost::scoped_ptr<RenderBuffer> render_buffer_;
+		boost::scoped_ptr<log_file> output_;	//只由后台线程替换,替换和其他线程读取都持有producers_mutex_
+		std::string reopen_basename_;		//由mutex_保护
+		boost::atomic<bool> reopen_pending_;
+		std::vector<log_iovec> batch_;		//后台线程一次写出的各个buffer
+		boost::atomic<bool> sleeping_;
+		boost::atomic<int> record_format_;	//RecordFormat,重新加载配置时由logger更新
+
+		//以下只由后台线程写
+		stat_counter written_records_[NULL_LEVEL];
+		stat_counter written_bytes_[NULL_LEVEL];
+		stat_counter buffer_swaps_;
+		stat_counter queue_high_water_;
+		stat_counter swaps_per_sec_;
+		stat_counter swaps_second_;			//swaps_per_sec_统计的是哪一秒
+		boost::uint64_t swaps_at_second_;	//这一秒开始时的buffer_swaps_
+		boost::uint64_t reported_drops_;	//已经报告过的丢弃条数
 	};
 
-	enum LogLevel
+	//日志文件,记录拷贝进async_logging的buffer,由它的后台线程批量写。
+	//分片时每个分片写basename.s0、basename.s1...,每条记录带全局序号
+	//"时间,级别,#序号,",合并时按序号恢复顺序
+	class file_sink : public log_sink
 	{
-		DEBUG_LEVEL =0,
-		INFO_LEVEL,
-		WARN_LEVEL,
-		ERR_LEVEL,
-		NULL_LEVEL
+	public:
+		file_sink(const std::string& basename , int flushInterval , const async_options& options);
+
+		void start();
+		void stop();
+		void write(log_record_ref& record);
+		//已经编码好的deferred记录,key见shard_key
+		void append(const char* record , int len , LogLevel level , size_t key = 0)
+		{
+			shard(key).append(record , len , level);
+		}
+		void get_stats(sink_stats* stats);
+		//各分片合计
+		void get_logging_stats(async_logging_stats* stats);
+		void get_overflow_stats(overflow_stats* stats);
+		const async_options& options() const { return options_; }
+		const std::string& basename() const { return basename_; }
+		bool sharded() const { return shards_.size() > 1; }
+		//不分片时为0
+		boost::uint64_t next_sequence()
+		{
+			return sharded() ? sequence_.fetch_add(1 , boost::memory_order_relaxed) + 1 : 0 ;
+		}
+		//换到新的目录或文件名,已经接收的日志写进哪个文件都不会丢
+		void reopen(const std::string& basename);
+		void set_record_format(RecordFormat format);
+
+	private:
+		//key为0或者按线程分片时用调用线程的编号
+		async_logging& shard(size_t key)
+		{
+			if (shards_.size() == 1)
+				return shards_[0];
+			if (key == 0 || options_.shard_by == SHARD_BY_THREAD)
+				key = thread_key();
+			return shards_[key % shards_.size()];
+		}
+		static size_t thread_key();
+		std::string shard_basename(const std::string& basename , size_t index) const;
+
+		const async_options options_ ;
+		std::string basename_ ;
+		boost::ptr_vector<async_logging> shards_ ;
+		boost::atomic<boost::uint64_t> sequence_ ;
+	};
+
+	//logconfig中的全部配置
+	struct logger_settings
+	{
+		logger_settings()
+			:console(false)
+			,file(false)
+			,console_level(DEBUG_LEVEL)
+			,file_level(DEBUG_LEVEL)
+			,console_format(FORMAT_TEXT)
+			,file_format(FORMAT_TEXT)
+			,watch(false)
+			,watch_interval_ms(1000)
+		{}
+
+		bool console , file ;
+		LogLevel console_level , file_level ;
+		RecordFormat console_format , file_format ;
+		std::string log_dir ;
+		std::string basename ;
+		async_options async ;
+		console_options console_output ;
+		std::vector<sink_options> sinks ;
+		std::vector<std::pair<std::string , LogLevel> > categories ;	//root为空串
+		bool watch ;			//监视配置文件,变化后重新加载
+		int watch_interval_ms ;	//轮询配置文件的间隔
+	};
+
+	//一次配置生效后的输出目的和级别。发布后不再修改,前端在rcu读临界区内无锁读取;
+	//被换下的快照等所有读者离开后才删除,不再使用的sink随之写完并停止
+	struct logger_snapshot
+	{
+		struct entry
+		{
+			std::string key ;	//重新加载时key相同的sink沿用
+			LogLevel level ;
+			RecordFormat format ;
+			boost::shared_ptr<log_sink> sink ;
+		};
+
+		logger_snapshot()
+			:file(NULL)
+			,file_level(NULL_LEVEL)
+			,text_level(NULL_LEVEL)
+			,threshold(NULL_LEVEL)
+			,deferred(false)
+			,time_precision(TIME_PRECISION_MS)
+		{
+			for(int i = 0; i < FORMAT_COUNT; ++i)
+				format_level[i] = NULL_LEVEL ;
+		}
+
+		std::vector<entry> sinks ;
+		file_sink* file ;		//sinks中的日志文件,延迟格式化和统计要用
+		LogLevel file_level ;
+		LogLevel text_level ;	//文件以外的sink中最低的级别
+		LogLevel threshold ;	//所有sink中最低的级别
+		LogLevel format_level[FORMAT_COUNT] ;	//选了每种格式的sink中最低的级别,没有时为NULL_LEVEL
+		bool deferred ;
+		TimePrecision time_precision ;
 	};
 
 	class logger
 	{
 		DECLARE_SINGLETON_CLASS(logger);
 	public:
+		~logger();
+
 		void init(const std::string& log_in_dir ,const std::string&basename ,LogLevel level) ; 
 		bool load_config(const std::string& filename);
+		//重新读取load_config加载过的文件,出错时保持原来的配置
+		bool reload();
 		void log(LogLevel level ,const char *logstr, ... );
+		//带分类的日志,按分类分片时用分类选分片
+		void log_cat(const log_category& cat , LogLevel level ,const char *logstr, ... );
 		void stop();
+		void get_overflow_stats(overflow_stats* stats);
+		void get_stats(async_logging_stats* stats);
+		void get_sink_stats(std::vector<sink_stats>* stats);
+		//按名字找到sink,例如取出memory sink中的记录。sink被重新加载的配置去掉后指针失效
+		log_sink* find_sink(const std::string& name);
+		//增加一个输出目的,logger接管它的生命期,重新加载配置时保留
+		void add_sink(log_sink* sink , LogLevel level = DEBUG_LEVEL , RecordFormat format = FORMAT_TEXT);
+
+		//按名字取得分类,不存在时连同上级一起创建,空串为root。
+		//返回的引用一直有效,可以保存在静态变量里:
+		//static fst_log_file::log_category& net_log = fst_log_file::logger::get("net.reactor");
+		static log_category& get(const std::string& name);
+
+#ifdef FILELOGGER_HAS_CXX11
+		//"{}"占位符格式化
+		template<typename... Args>
+		void log_fmt(LogLevel level , const char* logstr , const Args&... args)
+		{
+			if(!log_level_enabled(level))
+				return ; 
+
+			rcu_read_guard guard(rcu_);
+			const logger_snapshot& snapshot = *snapshot_.load(boost::memory_order_acquire);
+			char buffer[MAX_LOG_BUFFER_SIZE] ; 
+			int len = format_text(buffer , snapshot.time_precision , level , logstr , args...);
+			if(len > 0)
+				output(snapshot , level , buffer , len);
+		}
+
+		//由LOG_*_FMT宏调用,占位符个数已在编译期检查。key是分类的编号,没有分类时为0。
+		//延迟格式化时文件只记录调用点、时间戳和参数的原始字节
+		template<typename... Args>
+		void log_site_fmt(const log_site& site , size_t key , const char* logstr , const Args&... args)
+		{
+			LogLevel level = static_cast<LogLevel>(site.level);
+			rcu_read_guard guard(rcu_);
+			const logger_snapshot& snapshot = *snapshot_.load(boost::memory_order_acquire);
+			char buffer[MAX_LOG_BUFFER_SIZE] ; 
+			if(!snapshot.deferred)
+			{
+				int len = format_text(buffer , snapshot.time_precision , level , logstr , args...);
+				if(len > 0)
+					output(snapshot , level , buffer , len , true , key);
+				return ;
+			}
+
+			//文件以外的sink仍然要文本
+			if(level >= snapshot.text_level)
+			{
+				int len = format_text(buffer , snapshot.time_precision , level , logstr , args...);
+				if(len > 0)
+					output(snapshot , level , buffer , len , false);
+			}
+
+			if(snapshot.file == NULL || level < snapshot.file_level)
+				return ;
+
+			size_t size = sizeof(deferred_header) + deferred::encoded_size(args...);
+			if(size > sizeof buffer)
+			{
+				int len = format_text(buffer , snapshot.time_precision , level , logstr , args...);
+				if(len > 0)
+				{
+					log_record_ref record(level , buffer , len , key);
+					snapshot.file->write(record);
+				}
+				return ;
+			}
+
+			log_timestamp ts ;
+			log_clock_now(&ts , snapshot.time_precision);
+			deferred_header head ;
+			head.size = static_cast<boost::uint32_t>(size);
+			head.nsec = static_cast<boost::uint32_t>(ts.nsec);
+			head.sec = ts.sec ;
+			head.seq = snapshot.file->next_sequence();
+			head.site = &site ;
+			memcpy(buffer , &head , sizeof head);
+			deferred::encode(buffer + sizeof head , args...);
+			snapshot.file->append(buffer , static_cast<int>(size) , level , key);
+		}
+
+		//由LOG_*_KV宏调用:LOG_INFO_KV("conn closed" , "fd" , fd , "bytes" , n)。
+		//每种有sink选用的格式各编码一次,json和logfmt直接从参数编码,不经过文本
+		template<typename... Args>
+		void log_kv(size_t key , LogLevel level , const char* msg , const Args&... args)
+		{
+			rcu_read_guard guard(rcu_);
+			const logger_snapshot& snapshot = *snapshot_.load(boost::memory_order_acquire);
+			log_timestamp ts ;
+			log_clock_now(&ts , snapshot.time_precision);
+			for(int format = 0; format < FORMAT_COUNT; ++format)
+			{
+				if(level < snapshot.format_level[format])
+					continue ;
+				char buffer[MAX_LOG_BUFFER_SIZE] ; 
+				int len = kv::encode(buffer , sizeof buffer , static_cast<RecordFormat>(format) ,
+					ts , snapshot.time_precision , level , msg , args...);
+				if(len > 0)
+					output_format(snapshot , static_cast<RecordFormat>(format) , level , buffer , len , true , key);
+				else
+					count_oversized(snapshot , static_cast<RecordFormat>(format) , level , true);
+			}
+		}
+#endif
 
 	protected:
 		logger()
-			:is_console_log(false)
-			,is_file_log(false)
-		{}
+			:snapshot_(new logger_snapshot)
+			,stopped_(false)
+		{
+			categories_lock_.store(false);
+		}
 	private:
 		logger(const logger&);
 		logger& operator=(const logger&) ;
 
 	private:
-			void console_output(LogLevel level , const char* buffer , int len );
-			void logfile_output(LogLevel level , const char* buffer , int len) ; 
+			int format_head(char* buffer , TimePrecision precision , LogLevel level) ; 
+#ifdef FILELOGGER_HAS_CXX11
+			//格式化成一行文本,返回字节数,超长时返回-1
+			template<typename... Args>
+			int format_text(char* buffer , TimePrecision precision , LogLevel level , const char* logstr , const Args&... args)
+			{
+				fmt::writer w(buffer , MAX_LOG_BUFFER_SIZE);
+				w.add(format_head(buffer , precision , level));
+				fmt::format_to(w , logstr , args...);
+				w.write(LOG_EOL , sizeof(LOG_EOL) - 1);
+				return w.overflow() ? -1 : w.length() ;
+			}
+#endif
+			void vlog(size_t key , LogLevel level , const char* logstr , va_list args) ; 
+			//交给级别满足的各个sink,to_file为false时跳过文件,key见log_record_ref::shard_key。
+			//buffer是文本,选了json或logfmt的sink收到转换后的记录
+			void output(const logger_snapshot& snapshot , LogLevel level , const char* buffer , int len , bool to_file = true , size_t key = 0) ; 
+			//只交给选了format的sink,buffer已经是这种格式
+			void output_format(const logger_snapshot& snapshot , RecordFormat format , LogLevel level , const char* buffer , int len , bool to_file , size_t key) ; 
+			//转换成format后放不下而丢掉的记录,计入选了这种格式的sink
+			void count_oversized(const logger_snapshot& snapshot , RecordFormat format , LogLevel level , bool to_file) ; 
+			bool parse_config(const std::string& filename , logger_settings& settings) ; 
 			bool config_set_log_level(std::string& cfg , LogLevel& level) ; 
-			bool create_log_dir();
-			void start_logging();
+			bool config_set_record_format(TiXmlElement* root , const char* name , RecordFormat& format) ; 
+			bool config_set_async_options(TiXmlElement* root , async_options& options) ; 
+			bool config_set_time_precision(TiXmlElement* root , TimePrecision& precision) ; 
+			bool config_set_format_mode(TiXmlElement* root , bool& deferred) ; 
+			bool config_set_console(TiXmlElement* root , console_options& options) ; 
+			bool config_set_sinks(TiXmlElement* root , std::vector<sink_options>& sinks) ; 
+			bool config_set_categories(TiXmlElement* root , std::vector<std::pair<std::string , LogLevel> >& categories) ; 
+			bool config_set_watch(TiXmlElement* root , logger_settings& settings) ; 
+			//成功时retired为换下来的旧快照,释放config_mutex_后交给retire_snapshot
+			bool apply_settings_locked(const logger_settings& settings , logger_snapshot** retired);
+			logger_snapshot* publish_locked(logger_snapshot* snapshot);
+			void retire_snapshot(logger_snapshot* snapshot);
+			void set_category_levels(const std::vector<std::pair<std::string , LogLevel> >& categories);
+			log_category& category(const std::string& name);
+			log_category* find_category_locked(const std::string& name);
+			int category_level_locked(const log_category* category) const;
+			void update_category_levels();
+			bool create_log_dir(std::string& log_dir);
 			
 	private:
-		std::string basename_ ; 
-		LogLevel console_level_ , logfile_level_ ;
-		boost::scoped_ptr<async_logging> logfilePtr_ ;
-		bool is_console_log , is_file_log ; 
-		HANDLE hOut; 
-		std::string log_dir_;
+		rcu_domain rcu_ ;
+		boost::atomic<logger_snapshot*> snapshot_ ;	//当前生效的配置,只由持有config_mutex_的线程替换
+		boost::mutex config_mutex_ ;				//加载配置、增加sink互斥,可能早于threadctl初始化,不用threadctl的锁
+		logger_settings settings_ ;					//上次生效的配置,由config_mutex_保护
+		bool stopped_ ;								//stop()之后还没有重新加载,由config_mutex_保护
+		std::string config_file_ ;
+		boost::ptr_map<std::string , log_category> categories_ ;
+		boost::atomic<bool> categories_lock_ ;
+		boost::scoped_ptr<config_watcher> watcher_ ;	//析构时最先停止,不再触发重新加载
 
 	};
 
@@ -230,27 +818,183 @@ namespace fst_log_file
 
 #define LOG_LOAD_CONFIG(file)	 fst_log_file::sln_logger::instance().load_config(file)
 
+//编译期最低日志级别,低于它的LOG_*宏展开为空语句,参数不会被编译。
+//0:DEBUG 1:INFO 2:WARN 3:ERR 4:全部关闭,例如 -DFILELOGGER_MIN_LEVEL=1
+#ifndef FILELOGGER_MIN_LEVEL
+#define FILELOGGER_MIN_LEVEL	0
+#endif
+
+#define LOG_DISABLED_(...)	do {} while(0)
+
 #if defined(USE_LOG_FILE)
-	//ʹlogfile־
-	#define LOG_DBG(...)	fst_log_file::sln_logger::instance().log( fst_log_file::DEBUG_LEVEL,  __VA_ARGS__);
-	#define LOG_DEBUG(...)	fst_log_file::sln_logger::instance().log( fst_log_file::DEBUG_LEVEL,  __VA_ARGS__);
-	#define LOG_INFO(...)	fst_log_file::sln_logger::instance().log( fst_log_file::INFO_LEVEL,  __VA_ARGS__);
-	#define LOG_WARN(...)	fst_log_file::sln_logger::instance().log( fst_log_file::WARN_LEVEL,  __VA_ARGS__);
-	#define LOG_ERR(...)	fst_log_file::sln_logger::instance().log( fst_log_file::ERR_LEVEL,  __VA_ARGS__);
-	#define LOG_ERROR(...)	fst_log_file::sln_logger::instance().log( fst_log_file::ERR_LEVEL,  __VA_ARGS__);
+	//使用logfile日志,先检查级别再求值参数
+	#define LOG_PRINTF_IF_(enabled , level , ...)	do { if(enabled) \
+		fst_log_file::sln_logger::instance().log( level , __VA_ARGS__); } while(0)
+	#define LOG_PRINTF_(level , ...)	LOG_PRINTF_IF_(fst_log_file::log_level_enabled(level) , level , __VA_ARGS__)
+	//按分类的级别判断:LOG_CAT_DEBUG(net_log , "accept fd %d" , fd);
+	#define LOG_CAT_PRINTF_(cat , level , ...)	do { if((cat).enabled(level)) \
+		fst_log_file::sln_logger::instance().log_cat( cat , level , __VA_ARGS__); } while(0)
+
+#ifdef FILELOGGER_HAS_CXX11
+	//"{}"占位符格式:LOG_INFO_FMT("conn {} closed, {} bytes" , fd , n);
+	//每个调用点一个静态的log_site,延迟格式化时用它的地址代替格式串
+	#define LOG_FMT_IF_(enabled , key , level , ...)	do { LOG_FMT_CHECK(__VA_ARGS__); \
+		if(!(enabled)) break; \
+		static const fst_log_file::log_site log_site_ = { LOG_FMT_FIRST(__VA_ARGS__) , level , \
+			&decltype(fst_log_file::deferred::site_decoder(__VA_ARGS__))::decode }; \
+		fst_log_file::sln_logger::instance().log_site_fmt( log_site_ , key , __VA_ARGS__); } while(0)
+	#define LOG_FMT_(level , ...)	LOG_FMT_IF_(fst_log_file::log_level_enabled(level) , 0 , level , __VA_ARGS__)
+	#define LOG_CAT_FMT_(cat , level , ...)	LOG_FMT_IF_((cat).enabled(level) , (cat).id() , level , __VA_ARGS__)
+
+	//结构化日志:LOG_INFO_KV("conn closed" , "fd" , fd , "bytes" , n);
+	#define LOG_KV_IF_(enabled , key , level , ...)	do { if(enabled) \
+		fst_log_file::sln_logger::instance().log_kv( key , level , __VA_ARGS__); } while(0)
+	#define LOG_KV_(level , ...)	LOG_KV_IF_(fst_log_file::log_level_enabled(level) , 0 , level , __VA_ARGS__)
+	#define LOG_CAT_KV_(cat , level , ...)	LOG_KV_IF_((cat).enabled(level) , (cat).id() , level , __VA_ARGS__)
+#endif
 
 #else
-	//ʹlogfile־־ض򵽱׼
+	//不使用logfile日志，仅仅将日志重定向到标准输出
+	#define LOG_PRINTF_(level , ...)	printf(  __VA_ARGS__)
+	#define LOG_CAT_PRINTF_(cat , level , ...)	printf(  __VA_ARGS__)
+
+#ifdef FILELOGGER_HAS_CXX11
+	#define LOG_FMT_(level , ...)	do { LOG_FMT_CHECK(__VA_ARGS__); char fmt_buf_[MAX_LOG_BUFFER_SIZE]; \
+		fst_log_file::fmt::writer fmt_w_(fmt_buf_ , sizeof fmt_buf_ - 1); \
+		fst_log_file::fmt::format_to(fmt_w_ , __VA_ARGS__); \
+		fwrite(fmt_buf_ , 1 , fmt_w_.length() , stdout); } while(0)
+	#define LOG_CAT_FMT_(cat , level , ...)	LOG_FMT_(level , __VA_ARGS__)
+	#define LOG_KV_(level , ...)	do { char kv_buf_[MAX_LOG_BUFFER_SIZE]; \
+		fst_log_file::fmt::writer kv_w_(kv_buf_ , sizeof kv_buf_ - 1); \
+		fst_log_file::kv::write_body(kv_w_ , fst_log_file::FORMAT_TEXT , __VA_ARGS__); \
+		kv_w_.put('\n'); \
+		fwrite(kv_buf_ , 1 , kv_w_.length() , stdout); } while(0)
+	#define LOG_CAT_KV_(cat , level , ...)	LOG_KV_(level , __VA_ARGS__)
+#endif
+
+#endif
+
+#if FILELOGGER_MIN_LEVEL <= 0
+	#define LOG_DBG(...)	LOG_PRINTF_( fst_log_file::DEBUG_LEVEL , __VA_ARGS__);
+	#define LOG_DEBUG(...)	LOG_PRINTF_( fst_log_file::DEBUG_LEVEL , __VA_ARGS__);
+	#define LOG_CAT_DBG(cat , ...)	LOG_CAT_PRINTF_( cat , fst_log_file::DEBUG_LEVEL , __VA_ARGS__);
+	#define LOG_CAT_DEBUG(cat , ...)	LOG_CAT_PRINTF_( cat , fst_log_file::DEBUG_LEVEL , __VA_ARGS__);
+#else
+	#define LOG_DBG(...)	LOG_DISABLED_( __VA_ARGS__);
+	#define LOG_DEBUG(...)	LOG_DISABLED_( __VA_ARGS__);
+	#define LOG_CAT_DBG(cat , ...)	LOG_DISABLED_( __VA_ARGS__);
+	#define LOG_CAT_DEBUG(cat , ...)	LOG_DISABLED_( __VA_ARGS__);
+#endif
+
+#if FILELOGGER_MIN_LEVEL <= 1
+	#define LOG_INFO(...)	LOG_PRINTF_( fst_log_file::INFO_LEVEL , __VA_ARGS__);
+	#define LOG_CAT_INFO(cat , ...)	LOG_CAT_PRINTF_( cat , fst_log_file::INFO_LEVEL , __VA_ARGS__);
+#else
+	#define LOG_INFO(...)	LOG_DISABLED_( __VA_ARGS__);
+	#define LOG_CAT_INFO(cat , ...)	LOG_DISABLED_( __VA_ARGS__);
+#endif
 
-#define LOG_DBG(...)	printf(  __VA_ARGS__);
-#define LOG_DEBUG(...)	printf(  __VA_ARGS__);
-#define LOG_INFO(...)	printf(  __VA_ARGS__);
-#define LOG_WARN(...)	printf(  __VA_ARGS__);
-#define LOG_ERR(...)	printf(  __VA_ARGS__);
-#define LOG_ERROR(...)	printf(  __VA_ARGS__);
+#if FILELOGGER_MIN_LEVEL <= 2
+	#define LOG_WARN(...)	LOG_PRINTF_( fst_log_file::WARN_LEVEL , __VA_ARGS__);
+	#define LOG_CAT_WARN(cat , ...)	LOG_CAT_PRINTF_( cat , fst_log_file::WARN_LEVEL , __VA_ARGS__);
+#else
+	#define LOG_WARN(...)	LOG_DISABLED_( __VA_ARGS__);
+	#define LOG_CAT_WARN(cat , ...)	LOG_DISABLED_( __VA_ARGS__);
+#endif
+
+#if FILELOGGER_MIN_LEVEL <= 3
+	#define LOG_ERR(...)	LOG_PRINTF_( fst_log_file::ERR_LEVEL , __VA_ARGS__);
+	#define LOG_ERROR(...)	LOG_PRINTF_( fst_log_file::ERR_LEVEL , __VA_ARGS__);
+	#define LOG_CAT_ERR(cat , ...)	LOG_CAT_PRINTF_( cat , fst_log_file::ERR_LEVEL , __VA_ARGS__);
+	#define LOG_CAT_ERROR(cat , ...)	LOG_CAT_PRINTF_( cat , fst_log_file::ERR_LEVEL , __VA_ARGS__);
+#else
+	#define LOG_ERR(...)	LOG_DISABLED_( __VA_ARGS__);
+	#define LOG_ERROR(...)	LOG_DISABLED_( __VA_ARGS__);
+	#define LOG_CAT_ERR(cat , ...)	LOG_DISABLED_( __VA_ARGS__);
+	#define LOG_CAT_ERROR(cat , ...)	LOG_DISABLED_( __VA_ARGS__);
+#endif
+
+#ifdef FILELOGGER_HAS_CXX11
+#if FILELOGGER_MIN_LEVEL <= 0
+	#define LOG_DBG_FMT(...)	LOG_FMT_( fst_log_file::DEBUG_LEVEL , __VA_ARGS__)
+	#define LOG_DEBUG_FMT(...)	LOG_FMT_( fst_log_file::DEBUG_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_DBG_FMT(cat , ...)	LOG_CAT_FMT_( cat , fst_log_file::DEBUG_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_DEBUG_FMT(cat , ...)	LOG_CAT_FMT_( cat , fst_log_file::DEBUG_LEVEL , __VA_ARGS__)
+#else
+	#define LOG_DBG_FMT(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_DEBUG_FMT(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_DBG_FMT(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_DEBUG_FMT(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+#endif
+
+#if FILELOGGER_MIN_LEVEL <= 1
+	#define LOG_INFO_FMT(...)	LOG_FMT_( fst_log_file::INFO_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_INFO_FMT(cat , ...)	LOG_CAT_FMT_( cat , fst_log_file::INFO_LEVEL , __VA_ARGS__)
+#else
+	#define LOG_INFO_FMT(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_INFO_FMT(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+#endif
 
+#if FILELOGGER_MIN_LEVEL <= 2
+	#define LOG_WARN_FMT(...)	LOG_FMT_( fst_log_file::WARN_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_WARN_FMT(cat , ...)	LOG_CAT_FMT_( cat , fst_log_file::WARN_LEVEL , __VA_ARGS__)
+#else
+	#define LOG_WARN_FMT(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_WARN_FMT(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+#endif
+
+#if FILELOGGER_MIN_LEVEL <= 3
+	#define LOG_ERR_FMT(...)	LOG_FMT_( fst_log_file::ERR_LEVEL , __VA_ARGS__)
+	#define LOG_ERROR_FMT(...)	LOG_FMT_( fst_log_file::ERR_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_ERR_FMT(cat , ...)	LOG_CAT_FMT_( cat , fst_log_file::ERR_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_ERROR_FMT(cat , ...)	LOG_CAT_FMT_( cat , fst_log_file::ERR_LEVEL , __VA_ARGS__)
+#else
+	#define LOG_ERR_FMT(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_ERROR_FMT(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_ERR_FMT(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_ERROR_FMT(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+#endif
+
+#if FILELOGGER_MIN_LEVEL <= 0
+	#define LOG_DBG_KV(...)	LOG_KV_( fst_log_file::DEBUG_LEVEL , __VA_ARGS__)
+	#define LOG_DEBUG_KV(...)	LOG_KV_( fst_log_file::DEBUG_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_DBG_KV(cat , ...)	LOG_CAT_KV_( cat , fst_log_file::DEBUG_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_DEBUG_KV(cat , ...)	LOG_CAT_KV_( cat , fst_log_file::DEBUG_LEVEL , __VA_ARGS__)
+#else
+	#define LOG_DBG_KV(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_DEBUG_KV(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_DBG_KV(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_DEBUG_KV(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+#endif
+
+#if FILELOGGER_MIN_LEVEL <= 1
+	#define LOG_INFO_KV(...)	LOG_KV_( fst_log_file::INFO_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_INFO_KV(cat , ...)	LOG_CAT_KV_( cat , fst_log_file::INFO_LEVEL , __VA_ARGS__)
+#else
+	#define LOG_INFO_KV(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_INFO_KV(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+#endif
 
-#endif	
+#if FILELOGGER_MIN_LEVEL <= 2
+	#define LOG_WARN_KV(...)	LOG_KV_( fst_log_file::WARN_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_WARN_KV(cat , ...)	LOG_CAT_KV_( cat , fst_log_file::WARN_LEVEL , __VA_ARGS__)
+#else
+	#define LOG_WARN_KV(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_WARN_KV(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+#endif
+
+#if FILELOGGER_MIN_LEVEL <= 3
+	#define LOG_ERR_KV(...)	LOG_KV_( fst_log_file::ERR_LEVEL , __VA_ARGS__)
+	#define LOG_ERROR_KV(...)	LOG_KV_( fst_log_file::ERR_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_ERR_KV(cat , ...)	LOG_CAT_KV_( cat , fst_log_file::ERR_LEVEL , __VA_ARGS__)
+	#define LOG_CAT_ERROR_KV(cat , ...)	LOG_CAT_KV_( cat , fst_log_file::ERR_LEVEL , __VA_ARGS__)
+#else
+	#define LOG_ERR_KV(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_ERROR_KV(...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_ERR_KV(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+	#define LOG_CAT_ERROR_KV(cat , ...)	LOG_DISABLED_( __VA_ARGS__)
+#endif
+#endif
 
 } 
 
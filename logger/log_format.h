@@ -0,0 +1,239 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_format.h
+file path:	logfile
+file base:	log_format
+file ext:	h
+author:
+
+purpose:	类型安全的日志格式化,格式串使用"{}"作为占位符("{{"和"}}"
+			输出大括号本身)。占位符个数在编译期与参数个数比较,
+			格式化结果直接写入目标缓冲区,只扫描一遍。
+			编译期检查和变参接口需要C++11。
+*********************************************************************/
+#ifndef __LOG_FORMAT_INCLUDE__
+#define __LOG_FORMAT_INCLUDE__
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <boost/utility/string_view.hpp>
+#include <boost/type_traits.hpp>
+#include <boost/utility/enable_if.hpp>
+
+#if __cplusplus >= 201103L || (defined(_MSC_VER) && _MSC_VER >= 1900)
+#define  FILELOGGER_HAS_CXX11	1
+#endif
+
+namespace fst_log_file
+{
+namespace fmt
+{
+
+#ifdef FILELOGGER_HAS_CXX11
+	//编译期统计"{}"的个数,格式串中有落单的'{'或'}'时返回-1。
+	//逐字符递归,格式串长度受编译器constexpr递归深度限制(gcc默认512)
+	constexpr int count_placeholders(const char* s , int n = 0)
+	{
+		return *s == '\0' ? n
+			: (s[0] == '{' && s[1] == '{') ? count_placeholders(s + 2 , n)
+			: (s[0] == '}' && s[1] == '}') ? count_placeholders(s + 2 , n)
+			: (s[0] == '{' && s[1] == '}') ? count_placeholders(s + 2 , n + 1)
+			: (s[0] == '{' || s[0] == '}') ? -1
+			: count_placeholders(s + 1 , n);
+	}
+
+	//只用于在不求值的上下文中数参数个数
+	template<typename... Args>
+	char (&count_args(const Args&...))[sizeof...(Args) + 1];
+#endif
+
+	//向定长缓冲区追加内容,空间不够时置overflow,之后的写入都被忽略
+	class writer
+	{
+	public:
+		writer(char* buf , size_t size)
+			: begin_(buf), cur_(buf), end_(buf + size), overflow_(false)
+		{}
+
+		void put(char c)
+		{
+			if (cur_ < end_)
+				*cur_++ = c;
+			else
+				overflow_ = true;
+		}
+
+		void write(const char* s , size_t len)
+		{
+			if (static_cast<size_t>(end_ - cur_) >= len)
+			{
+				memcpy(cur_ , s , len);
+				cur_ += len;
+			}
+			else
+				overflow_ = true;
+		}
+
+		char* current() { return cur_; }
+		size_t avail() const { return end_ - cur_; }
+		void add(size_t len) { cur_ += len; }
+		void set_overflow() { overflow_ = true; }
+
+		bool overflow() const { return overflow_; }
+		int length() const { return static_cast<int>(cur_ - begin_); }
+
+	private:
+		char* begin_;
+		char* cur_;
+		char* end_;
+		bool overflow_;
+	};
+
+	//整数从低位向高位写到临时区,再整体拷贝
+	template<typename T>
+	inline void write_unsigned(writer& w , T value)
+	{
+		char tmp[24];
+		char* p = tmp + sizeof tmp;
+		do
+		{
+			*--p = static_cast<char>('0' + value % 10);
+			value /= 10;
+		} while (value != 0);
+		w.write(p , tmp + sizeof tmp - p);
+	}
+
+	template<typename T>
+	inline typename boost::enable_if_c<boost::is_integral<T>::value && boost::is_signed<T>::value>::type
+		format_arg(writer& w , T value)
+	{
+		typedef typename boost::make_unsigned<T>::type U;
+		if (value < 0)
+		{
+			w.put('-');
+			write_unsigned(w , static_cast<U>(0 - static_cast<U>(value)));
+		}
+		else
+			write_unsigned(w , static_cast<U>(value));
+	}
+
+	template<typename T>
+	inline typename boost::enable_if_c<boost::is_integral<T>::value && !boost::is_signed<T>::value>::type
+		format_arg(writer& w , T value)
+	{
+		write_unsigned(w , value);
+	}
+
+	template<typename T>
+	inline typename boost::enable_if_c<boost::is_enum<T>::value>::type
+		format_arg(writer& w , T value)
+	{
+		format_arg(w , static_cast<long>(value));
+	}
+
+	inline void format_arg(writer& w , bool value)
+	{
+		if (value)
+			w.write("true" , 4);
+		else
+			w.write("false" , 5);
+	}
+
+	inline void format_arg(writer& w , char value) { w.put(value); }
+
+	//浮点数按%g输出,直接写入目标缓冲区
+	inline void format_arg(writer& w , double value)
+	{
+		int n = snprintf(w.current() , w.avail() , "%g" , value);
+		if (n < 0 || static_cast<size_t>(n) >= w.avail())
+			w.set_overflow();
+		else
+			w.add(n);
+	}
+	inline void format_arg(writer& w , float value) { format_arg(w , static_cast<double>(value)); }
+	inline void format_arg(writer& w , long double value) { format_arg(w , static_cast<double>(value)); }
+
+	inline void format_arg(writer& w , boost::string_view value) { w.write(value.data() , value.size()); }
+	inline void format_arg(writer& w , const std::string& value) { w.write(value.data() , value.size()); }
+	inline void format_arg(writer& w , const char* value)
+	{
+		if (value)
+			w.write(value , strlen(value));
+		else
+			w.write("(null)" , 6);
+	}
+	inline void format_arg(writer& w , char* value) { format_arg(w , static_cast<const char*>(value)); }
+
+	//其余指针输出为0x开头的十六进制地址
+	inline void format_arg(writer& w , const void* value)
+	{
+		static const char kHex[] = "0123456789abcdef";
+		size_t v = reinterpret_cast<size_t>(value);
+		char tmp[2 + sizeof(size_t) * 2];
+		char* p = tmp + sizeof tmp;
+		do
+		{
+			*--p = kHex[v & 0xf];
+			v >>= 4;
+		} while (v != 0);
+		*--p = 'x';
+		*--p = '0';
+		w.write(p , tmp + sizeof tmp - p);
+	}
+	template<typename T>
+	inline void format_arg(writer& w , T* value) { format_arg(w , static_cast<const void*>(value)); }
+
+	//输出下一个占位符之前的普通文本,返回占位符之后的位置,没有占位符时返回NULL
+	inline const char* copy_literal(writer& w , const char* fmt)
+	{
+		const char* p = fmt;
+		for (;;)
+		{
+			const char* brace = p + strcspn(p , "{}");
+			w.write(p , brace - p);
+			if (*brace == '\0')
+				return NULL;
+			if (brace[0] == brace[1])
+			{
+				//"{{" 或 "}}"
+				w.put(brace[0]);
+				p = brace + 2;
+				continue;
+			}
+			return brace + 2;
+		}
+	}
+
+	inline void format_to(writer& w , const char* fmt)
+	{
+		copy_literal(w , fmt);
+	}
+
+#ifdef FILELOGGER_HAS_CXX11
+	template<typename T , typename... Args>
+	inline void format_to(writer& w , const char* fmt , const T& value , const Args&... args)
+	{
+		const char* next = copy_literal(w , fmt);
+		if (next == NULL)
+			return;
+		format_arg(w , value);
+		format_to(w , next , args...);
+	}
+#endif
+
+}
+}
+
+#ifdef FILELOGGER_HAS_CXX11
+//第一个参数必须是格式串字面量,占位符个数与其余参数个数在编译期比较
+#define LOG_FMT_EXPAND_(x)	x
+#define LOG_FMT_FIRST_(fmt , ...)	fmt
+#define LOG_FMT_FIRST(...)		LOG_FMT_EXPAND_(LOG_FMT_FIRST_(__VA_ARGS__ , 0))
+#define LOG_FMT_CHECK(...)	\
+	static_assert(fst_log_file::fmt::count_placeholders(LOG_FMT_FIRST(__VA_ARGS__)) ==	\
+		static_cast<int>(sizeof(fst_log_file::fmt::count_args(__VA_ARGS__))) - 2 ,		\
+		"log format: placeholder count does not match argument count")
+#endif
+
+#endif
@@ -0,0 +1,366 @@
+#include "stdafx.h"
+#include <stdio.h>
+#include <string.h>
+#include "log_file.h"
+#include "log_kv.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define  LOG_KV_SSE2	1
+#include <emmintrin.h>
+#endif
+
+namespace fst_log_file
+{
+namespace kv
+{
+
+static const char kLevelChar[NULL_LEVEL] = { 'D' , 'I' , 'W' , 'E' };
+static const char* const kLevelName[NULL_LEVEL] = { "debug" , "info" , "warn" , "error" };
+
+static inline bool is_special(unsigned char c , RecordFormat format)
+{
+	return c < 0x20 || c == '"' || c == '\\' || (format == FORMAT_LOGFMT && (c == ' ' || c == '='))
+		|| (format == FORMAT_JSON && c >= 0x80);
+}
+
+#ifdef LOG_KV_SSE2
+static inline int first_bit(unsigned int mask)
+{
+#ifdef _MSC_VER
+	unsigned long index ;
+	_BitScanForward(&index , mask);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+//第一个需要转义的字节的位置,没有时返回len。text只找引号、反斜杠和控制字符,
+//logfmt还要找空格和'='(决定是否加引号),json还要找>=0x80的字节(检查UTF-8)
+static size_t find_special(const char* s , size_t len , RecordFormat format)
+{
+	const bool logfmt = format == FORMAT_LOGFMT ;
+	size_t i = 0 ;
+#ifdef LOG_KV_SSE2
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i backslash = _mm_set1_epi8('\\');
+	const __m128i space = _mm_set1_epi8(logfmt ? ' ' : '"');
+	const __m128i equals = _mm_set1_epi8(logfmt ? '=' : '"');
+	const __m128i ctrl_max = _mm_set1_epi8(0x1f);
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + i));
+		//无符号比较v <= 0x1f
+		__m128i hit = _mm_cmpeq_epi8(_mm_max_epu8(v , ctrl_max) , ctrl_max);
+		hit = _mm_or_si128(hit , _mm_cmpeq_epi8(v , quote));
+		hit = _mm_or_si128(hit , _mm_cmpeq_epi8(v , backslash));
+		hit = _mm_or_si128(hit , _mm_cmpeq_epi8(v , space));
+		hit = _mm_or_si128(hit , _mm_cmpeq_epi8(v , equals));
+		unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(hit));
+		if (format == FORMAT_JSON)
+			mask |= static_cast<unsigned int>(_mm_movemask_epi8(v));
+		if (mask != 0)
+			return i + first_bit(mask);
+	}
+#endif
+	for (; i < len; ++i)
+	{
+		if (is_special(static_cast<unsigned char>(s[i]) , format))
+			return i ;
+	}
+	return len ;
+}
+
+//截断时不从UTF-8字符中间断开,返回不超过n的断点
+static size_t char_boundary(const char* s , size_t n)
+{
+	while (n > 0 && (static_cast<unsigned char>(s[n]) & 0xc0) == 0x80)
+		--n ;
+	return n ;
+}
+
+//s开始的合法UTF-8字符的字节数,不合法时返回0
+static size_t utf8_char_length(const unsigned char* s , size_t len)
+{
+	unsigned char c = s[0];
+	unsigned char lo = 0x80 ;
+	unsigned char hi = 0xbf ;
+	size_t n ;
+	if (c >= 0xc2 && c <= 0xdf)
+		n = 2 ;
+	else if (c >= 0xe0 && c <= 0xef)
+	{
+		n = 3 ;
+		if (c == 0xe0)
+			lo = 0xa0 ;		//过长编码
+		else if (c == 0xed)
+			hi = 0x9f ;		//代理区
+	}
+	else if (c >= 0xf0 && c <= 0xf4)
+	{
+		n = 4 ;
+		if (c == 0xf0)
+			lo = 0x90 ;
+		else if (c == 0xf4)
+			hi = 0x8f ;		//超过U+10FFFF
+	}
+	else
+		return 0 ;
+
+	if (len < n || s[1] < lo || s[1] > hi)
+		return 0 ;
+	for (size_t i = 2; i < n; ++i)
+	{
+		if ((s[i] & 0xc0) != 0x80)
+			return 0 ;
+	}
+	return n ;
+}
+
+//最多写limit字节,不拆开转义序列,写不完时返回false。
+//json要求UTF-8,不是合法UTF-8的字节(例如GBK)写成\ufffd
+static bool escape_limited(fmt::writer& w , RecordFormat format , const char* s , size_t len , size_t limit)
+{
+	static const char kHex[] = "0123456789abcdef";
+	static const char kReplacement[] = "\\ufffd";
+	const RecordFormat scan = format == FORMAT_JSON ? FORMAT_JSON : FORMAT_TEXT ;
+	while (len > 0)
+	{
+		size_t plain = find_special(s , len , scan);
+		if (plain > limit)
+		{
+			w.write(s , char_boundary(s , limit));
+			return false ;
+		}
+		w.write(s , plain);
+		limit -= plain ;
+		if (plain == len)
+			return true ;
+
+		unsigned char c = static_cast<unsigned char>(s[plain]);
+		if (c >= 0x80)
+		{
+			size_t n = utf8_char_length(reinterpret_cast<const unsigned char*>(s + plain) , len - plain);
+			const char* unit = n ? s + plain : kReplacement ;
+			size_t unit_len = n ? n : sizeof kReplacement - 1 ;
+			if (unit_len > limit)
+				return false ;
+			w.write(unit , unit_len);
+			limit -= unit_len ;
+			s += plain + (n ? n : 1) ;
+			len -= plain + (n ? n : 1) ;
+			continue ;
+		}
+
+		char seq[6] = { '\\' , 'u' , '0' , '0' , kHex[c >> 4] , kHex[c & 0xf] };
+		size_t seq_len = 2 ;
+		switch (c)
+		{
+		case '"': seq[1] = '"'; break;
+		case '\\': seq[1] = '\\'; break;
+		case '\n': seq[1] = 'n'; break;
+		case '\r': seq[1] = 'r'; break;
+		case '\t': seq[1] = 't'; break;
+		case '\b': seq[1] = 'b'; break;
+		case '\f': seq[1] = 'f'; break;
+		default: seq_len = sizeof seq; break;
+		}
+		if (seq_len > limit)
+			return false ;
+		w.write(seq , seq_len);
+		limit -= seq_len ;
+		s += plain + 1 ;
+		len -= plain + 1 ;
+	}
+	return true ;
+}
+
+void escape(fmt::writer& w , RecordFormat format , const char* s , size_t len)
+{
+	escape_limited(w , format , s , len , static_cast<size_t>(-1));
+}
+
+void write_string(fmt::writer& w , RecordFormat format , const char* s , size_t len)
+{
+	if (format == FORMAT_TEXT || (format == FORMAT_LOGFMT && len > 0 && find_special(s , len , FORMAT_LOGFMT) == len))
+	{
+		w.write(s , len);
+		return ;
+	}
+	w.put('"');
+	escape(w , format , s , len);
+	w.put('"');
+}
+
+//放不下时截短字符串,末尾加"...",logfmt这时总是加引号
+static void write_string_truncated(fmt::writer& w , RecordFormat format , const char* s , size_t len)
+{
+	static const char kEllipsis[] = "...";
+	const size_t reserve = (sizeof kEllipsis - 1) + (format == FORMAT_TEXT ? 0 : 2) ;
+	if (w.avail() < reserve)
+	{
+		w.set_overflow();
+		return ;
+	}
+	const size_t limit = w.avail() - reserve ;
+	bool complete ;
+	if (format == FORMAT_TEXT)
+	{
+		complete = len <= limit ;
+		w.write(s , complete ? len : char_boundary(s , limit));
+	}
+	else
+	{
+		w.put('"');
+		complete = escape_limited(w , format , s , len , limit);
+	}
+	if (!complete)
+		w.write(kEllipsis , sizeof kEllipsis - 1);
+	if (format != FORMAT_TEXT)
+		w.put('"');
+}
+
+void write_key(fmt::writer& w , RecordFormat format , const char* key)
+{
+	if (format == FORMAT_JSON)
+	{
+		w.write(",\"" , 2);
+		escape(w , format , key , strlen(key));
+		w.write("\":" , 2);
+	}
+	else
+	{
+		//键和值一样,含空格、'='、引号或控制字符时加引号转义
+		w.put(' ');
+		write_string(w , format , key , strlen(key));
+		w.put('=');
+	}
+}
+
+void write_value(fmt::writer& w , RecordFormat format , double value)
+{
+	if (format == FORMAT_JSON && (value != value || value - value != 0))
+	{
+		w.write("null" , 4);
+		return ;
+	}
+	int n = snprintf(w.current() , w.avail() , "%.15g" , value);
+	if (n < 0 || static_cast<size_t>(n) >= w.avail())
+		w.set_overflow();
+	else
+		w.add(n);
+}
+
+//time是已经格式化好的时间,结构化格式里日期和时间之间用'T'。truncate时消息写到w放不下为止
+static void write_head_text(fmt::writer& w , RecordFormat format , const char* time , size_t time_len ,
+	LogLevel level , const char* msg , size_t msg_len , bool truncate)
+{
+	if (format == FORMAT_TEXT)
+	{
+		w.write(time , time_len);
+		w.put(',');
+		w.put(kLevelChar[level]);
+		w.put(',');
+		if (truncate)
+			write_string_truncated(w , format , msg , msg_len);
+		else
+			w.write(msg , msg_len);
+		return ;
+	}
+
+	const char* name = kLevelName[level];
+	if (format == FORMAT_JSON)
+		w.write("{\"ts\":\"" , 7);
+	else
+		w.write("ts=" , 3);
+	char* t = w.current();
+	w.write(time , time_len);
+	if (time_len > 10 && w.current() == t + time_len && t[10] == ' ')
+		t[10] = 'T';
+
+	if (format == FORMAT_JSON)
+	{
+		w.write("\",\"level\":\"" , 11);
+		w.write(name , strlen(name));
+		w.write("\",\"msg\":" , 8);
+	}
+	else
+	{
+		w.write(" level=" , 7);
+		w.write(name , strlen(name));
+		w.write(" msg=" , 5);
+	}
+	if (truncate)
+		write_string_truncated(w , format , msg , msg_len);
+	else
+		write_string(w , format , msg , msg_len);
+}
+
+//buffer开头已经写好了key/value和结尾,共rest字节。把它们挪到末尾,前面写记录头,
+//消息截短到正好放下,再把key/value和结尾接上
+static int prepend_head(char* buffer , size_t size , size_t rest , RecordFormat format , const char* time , size_t time_len ,
+	LogLevel level , const char* msg , size_t msg_len)
+{
+	memmove(buffer + size - rest , buffer , rest);
+	fmt::writer w(buffer , size - rest);
+	write_head_text(w , format , time , time_len , level , msg , msg_len , true);
+	if (w.overflow())
+		return -1 ;
+	memmove(buffer + w.length() , buffer + size - rest , rest);
+	return w.length() + static_cast<int>(rest);
+}
+
+void write_head(fmt::writer& w , RecordFormat format , const log_timestamp& ts , TimePrecision precision ,
+	LogLevel level , const char* msg , size_t msg_len)
+{
+	char time[40] ;
+	int time_len = format_log_time(time , ts , precision);
+	write_head_text(w , format , time , time_len , level , msg , msg_len , false);
+}
+
+int encode_truncated(char* buffer , size_t size , size_t rest , RecordFormat format , const log_timestamp& ts ,
+	TimePrecision precision , LogLevel level , const char* msg , size_t msg_len)
+{
+	char time[40] ;
+	int time_len = format_log_time(time , ts , precision);
+	return prepend_head(buffer , size , rest , format , time , time_len , level , msg , msg_len);
+}
+
+void write_tail(fmt::writer& w , RecordFormat format)
+{
+	if (format == FORMAT_JSON)
+		w.put('}');
+	w.write(LOG_EOL , sizeof(LOG_EOL) - 1);
+}
+
+int convert_text(char* buffer , size_t size , RecordFormat format , LogLevel level , const char* text , int len)
+{
+	const char* end = text + len ;
+	while (end > text && (end[-1] == '\n' || end[-1] == '\r'))
+		--end ;
+
+	//"时间,级别,消息",不是这个样子时整行作为消息
+	const char* time_end = static_cast<const char*>(memchr(text , ',' , end - text));
+	const char* msg = text ;
+	size_t time_len = 0 ;
+	if (time_end && end - time_end >= 3 && time_end[2] == ',')
+	{
+		time_len = time_end - text ;
+		msg = time_end + 3 ;
+	}
+
+	fmt::writer w(buffer , size);
+	write_head_text(w , format , text , time_len , level , msg , end - msg , false);
+	write_tail(w , format);
+	if (!w.overflow())
+		return w.length();
+
+	//转义后比文本长,截短消息
+	fmt::writer tail(buffer , size);
+	write_tail(tail , format);
+	return prepend_head(buffer , size , tail.length() , format , text , time_len , level , msg , end - msg);
+}
+
+}
+}
@@ -0,0 +1,157 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_kv.h
+file path:	logfile
+file base:	log_kv
+file ext:	h
+author:
+
+purpose:	结构化日志的编码。一条记录是消息加若干key/value对,按sink选的
+			格式编码成文本、JSON行或logfmt,直接写入调用者的缓冲区,
+			数字不经过堆分配,字符串的转义用SSE2每次检查16字节。
+			变参接口需要C++11。
+*********************************************************************/
+#ifndef __LOG_KV_INCLUDE__
+#define __LOG_KV_INCLUDE__
+
+#include <string.h>
+#include <string>
+#include <boost/utility/string_view.hpp>
+#include <boost/type_traits.hpp>
+#include <boost/utility/enable_if.hpp>
+#include "log_format.h"
+#include "log_time.h"
+#include "log_sink.h"
+
+namespace fst_log_file
+{
+namespace kv
+{
+
+	//按JSON的规则转义'"'、'\\'和控制字符,不加引号;json时不是合法UTF-8的字节写成\ufffd
+	void escape(fmt::writer& w , RecordFormat format , const char* s , size_t len);
+
+	//json加引号并转义;logfmt只在为空或含空格、'='、'"'、控制字符时加引号;text原样输出
+	void write_string(fmt::writer& w , RecordFormat format , const char* s , size_t len);
+
+	//json为,"key":,其余为 key=,logfmt的键按write_string的规则加引号
+	void write_key(fmt::writer& w , RecordFormat format , const char* key);
+
+	//记录开头的时间、级别和消息
+	void write_head(fmt::writer& w , RecordFormat format , const log_timestamp& ts , TimePrecision precision ,
+		LogLevel level , const char* msg , size_t msg_len);
+
+	//json补上'}',再加换行
+	void write_tail(fmt::writer& w , RecordFormat format);
+
+	//把logger::log格式化好的"时间,级别,消息\r\n"转换成json或logfmt,返回字节数。
+	//转义后放不下时截短消息并加"...",仍然放不下时返回-1
+	int convert_text(char* buffer , size_t size , RecordFormat format , LogLevel level , const char* text , int len);
+
+	//encode放不下时调用:buffer开头是已经写好的key/value和结尾,共rest字节,
+	//在它们前面写记录头并截短消息,返回总字节数,仍然放不下时返回-1
+	int encode_truncated(char* buffer , size_t size , size_t rest , RecordFormat format , const log_timestamp& ts ,
+		TimePrecision precision , LogLevel level , const char* msg , size_t msg_len);
+
+	inline void write_value(fmt::writer& w , RecordFormat format , const char* value)
+	{
+		if (value)
+			write_string(w , format , value , strlen(value));
+		else if (format == FORMAT_JSON)
+			w.write("null" , 4);
+		else
+			w.write("(null)" , 6);
+	}
+	inline void write_value(fmt::writer& w , RecordFormat format , char* value)
+	{
+		write_value(w , format , static_cast<const char*>(value));
+	}
+	inline void write_value(fmt::writer& w , RecordFormat format , const std::string& value)
+	{
+		write_string(w , format , value.data() , value.size());
+	}
+	inline void write_value(fmt::writer& w , RecordFormat format , boost::string_view value)
+	{
+		write_string(w , format , value.data() , value.size());
+	}
+	inline void write_value(fmt::writer& w , RecordFormat format , char value)
+	{
+		write_string(w , format , &value , 1);
+	}
+	inline void write_value(fmt::writer& w , RecordFormat , bool value)
+	{
+		fmt::format_arg(w , value);
+	}
+
+	//浮点数保留15位有效数字;json里没有inf和nan,输出null
+	void write_value(fmt::writer& w , RecordFormat format , double value);
+	inline void write_value(fmt::writer& w , RecordFormat format , float value)
+	{
+		write_value(w , format , static_cast<double>(value));
+	}
+
+	template<typename T>
+	inline typename boost::enable_if_c<(boost::is_integral<T>::value || boost::is_enum<T>::value)
+		&& !boost::is_same<T , bool>::value && !boost::is_same<T , char>::value>::type
+		write_value(fmt::writer& w , RecordFormat , T value)
+	{
+		fmt::format_arg(w , value);
+	}
+
+	//其余指针按地址输出,json里是字符串
+	template<typename T>
+	inline void write_value(fmt::writer& w , RecordFormat format , T* value)
+	{
+		char tmp[2 + sizeof(size_t) * 2];
+		fmt::writer addr(tmp , sizeof tmp);
+		fmt::format_arg(addr , static_cast<const void*>(value));
+		write_string(w , format , tmp , addr.length());
+	}
+
+#ifdef FILELOGGER_HAS_CXX11
+	inline void write_pairs(fmt::writer& , RecordFormat) {}
+
+	template<typename V , typename... Rest>
+	inline void write_pairs(fmt::writer& w , RecordFormat format , const char* key , const V& value , const Rest&... rest)
+	{
+		write_key(w , format , key);
+		write_value(w , format , value);
+		write_pairs(w , format , rest...);
+	}
+
+	//消息和key/value对,不带时间和级别,没有启用logfile时直接输出用
+	template<typename... Args>
+	inline void write_body(fmt::writer& w , RecordFormat format , const char* msg , const Args&... args)
+	{
+		static_assert(sizeof...(Args) % 2 == 0 , "LOG_*_KV needs key/value pairs");
+		w.write(msg , strlen(msg));
+		write_pairs(w , format , args...);
+	}
+
+	//编码一整条记录,返回字节数。放不下时截短消息,key/value照常写;key/value本身放不下时返回-1
+	template<typename... Args>
+	inline int encode(char* buffer , size_t size , RecordFormat format , const log_timestamp& ts , TimePrecision precision ,
+		LogLevel level , const char* msg , const Args&... args)
+	{
+		static_assert(sizeof...(Args) % 2 == 0 , "LOG_*_KV needs key/value pairs");
+		const size_t msg_len = strlen(msg);
+		fmt::writer w(buffer , size);
+		write_head(w , format , ts , precision , level , msg , msg_len);
+		write_pairs(w , format , args...);
+		write_tail(w , format);
+		if (!w.overflow())
+			return w.length();
+
+		fmt::writer rest(buffer , size);
+		write_pairs(rest , format , args...);
+		write_tail(rest , format);
+		if (rest.overflow())
+			return -1 ;
+		return encode_truncated(buffer , size , rest.length() , format , ts , precision , level , msg , msg_len);
+	}
+#endif
+
+}
+}
+
+#endif
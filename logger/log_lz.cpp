@@ -0,0 +1,379 @@
+#include "stdafx.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include "log_lz.h"
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fst_log_file
+{
+namespace lz
+{
+
+typedef boost::uint32_t u32 ;
+typedef unsigned char byte ;
+
+static const int kHashLog = 14 ;
+static const size_t kMinMatch = 4 ;
+//与LZ4块格式的约定一致:最后5个字节总是字面量,最后一个匹配至少在结尾前12字节开始
+static const size_t kLastLiterals = 5 ;
+static const size_t kMatchLimit = 12 ;
+static const size_t kMaxOffset = 65535 ;
+
+static inline u32 read32(const byte* p)
+{
+	u32 v ;
+	memcpy(&v , p , sizeof v);
+	return v ;
+}
+
+static inline u32 hash_seq(u32 v)
+{
+	return (v * 2654435761u) >> (32 - kHashLog);
+}
+
+static inline byte* write_length(byte* op , size_t len)
+{
+	while (len >= 255)
+	{
+		*op++ = 255 ;
+		len -= 255 ;
+	}
+	*op++ = static_cast<byte>(len);
+	return op ;
+}
+
+static byte* write_sequence(byte* op , const byte* literal , size_t literal_len , size_t offset , size_t match_len)
+{
+	byte* token = op++ ;
+	size_t ml = match_len - kMinMatch ;
+	*token = static_cast<byte>(((literal_len >= 15 ? 15 : literal_len) << 4) | (ml >= 15 ? 15 : ml));
+	if (literal_len >= 15)
+		op = write_length(op , literal_len - 15);
+	memcpy(op , literal , literal_len);
+	op += literal_len ;
+	*op++ = static_cast<byte>(offset & 0xff);
+	*op++ = static_cast<byte>(offset >> 8);
+	if (ml >= 15)
+		op = write_length(op , ml - 15);
+	return op ;
+}
+
+size_t compress(const char* source , size_t n , char* dest)
+{
+	const byte* src = reinterpret_cast<const byte*>(source);
+	const byte* const end = src + n ;
+	const byte* anchor = src ;
+	byte* op = reinterpret_cast<byte*>(dest);
+
+	if (n > kMatchLimit + 1)
+	{
+		//表里存相对src的位置,命中后还要比较内容,初值0不会造成错误
+		std::vector<u32> table(1 << kHashLog , 0);
+		const byte* const match_limit = end - kMatchLimit ;
+		const byte* const match_end = end - kLastLiterals ;
+		const byte* ip = src + 1 ;
+		while (ip < match_limit)
+		{
+			u32 seq = read32(ip);
+			u32 h = hash_seq(seq);
+			const byte* ref = src + table[h];
+			table[h] = static_cast<u32>(ip - src);
+			if (ref >= ip || static_cast<size_t>(ip - ref) > kMaxOffset || read32(ref) != seq)
+			{
+				//长时间没有匹配时加大步长,不可压缩的数据很快跳过
+				ip += 1 + ((ip - anchor) >> 6);
+				continue ;
+			}
+
+			const byte* mp = ip + kMinMatch ;
+			const byte* rp = ref + kMinMatch ;
+			while (mp < match_end && *mp == *rp)
+			{
+				++mp ;
+				++rp ;
+			}
+			op = write_sequence(op , anchor , ip - anchor , ip - ref , mp - ip);
+			ip = mp ;
+			anchor = ip ;
+			if (ip < match_limit)
+				table[hash_seq(read32(ip - 2))] = static_cast<u32>(ip - 2 - src);
+		}
+	}
+
+	//剩下的都是字面量
+	size_t literal_len = end - anchor ;
+	*op++ = static_cast<byte>((literal_len >= 15 ? 15 : literal_len) << 4);
+	if (literal_len >= 15)
+		op = write_length(op , literal_len - 15);
+	memcpy(op , anchor , literal_len);
+	op += literal_len ;
+	return op - reinterpret_cast<byte*>(dest);
+}
+
+static inline bool read_length(const byte*& ip , const byte* iend , size_t& len)
+{
+	byte b ;
+	do
+	{
+		if (ip >= iend)
+			return false ;
+		b = *ip++ ;
+		len += b ;
+	} while (b == 255);
+	return true ;
+}
+
+bool decompress(const char* source , size_t n , char* dest , size_t raw_n)
+{
+	const byte* ip = reinterpret_cast<const byte*>(source);
+	const byte* const iend = ip + n ;
+	byte* const ostart = reinterpret_cast<byte*>(dest);
+	byte* op = ostart ;
+	byte* const oend = ostart + raw_n ;
+
+	while (ip < iend)
+	{
+		byte token = *ip++ ;
+		size_t literal_len = token >> 4 ;
+		if (literal_len == 15 && !read_length(ip , iend , literal_len))
+			return false ;
+		if (literal_len > static_cast<size_t>(iend - ip) || literal_len > static_cast<size_t>(oend - op))
+			return false ;
+		memcpy(op , ip , literal_len);
+		ip += literal_len ;
+		op += literal_len ;
+		if (ip == iend)
+			break ;
+
+		if (iend - ip < 2)
+			return false ;
+		size_t offset = ip[0] | (ip[1] << 8);
+		ip += 2 ;
+		if (offset == 0 || offset > static_cast<size_t>(op - ostart))
+			return false ;
+		size_t match_len = token & 15 ;
+		if (match_len == 15 && !read_length(ip , iend , match_len))
+			return false ;
+		match_len += kMinMatch ;
+		if (match_len > static_cast<size_t>(oend - op))
+			return false ;
+
+		const byte* match = op - offset ;
+		if (offset >= match_len)
+		{
+			memcpy(op , match , match_len);
+			op += match_len ;
+		}
+		else
+		{
+			//重叠的匹配只能逐字节复制
+			while (match_len--)
+				*op++ = *match++ ;
+		}
+	}
+	return op == oend ;
+}
+
+static void put32(byte* p , u32 v)
+{
+	p[0] = static_cast<byte>(v);
+	p[1] = static_cast<byte>(v >> 8);
+	p[2] = static_cast<byte>(v >> 16);
+	p[3] = static_cast<byte>(v >> 24);
+}
+
+static u32 get32(const byte* p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | (static_cast<u32>(p[3]) << 24);
+}
+
+size_t encode_block(const char* src , size_t n , char* dst)
+{
+	byte* header = reinterpret_cast<byte*>(dst);
+	size_t len = compress(src , n , dst + 8);
+	u32 flag = 0 ;
+	if (len >= n)
+	{
+		//压不小就原样存
+		memcpy(dst + 8 , src , n);
+		len = n ;
+		flag = kStoredFlag ;
+	}
+	put32(header , static_cast<u32>(n));
+	put32(header + 4 , static_cast<u32>(len) | flag);
+	return len + 8 ;
+}
+
+bool scan_file(const std::string& filename , boost::uint64_t* valid_length)
+{
+	*valid_length = 0 ;
+	FILE* in = ::fopen(filename.c_str() , "rb");
+	if (in == NULL)
+		return true ;
+
+	byte header[8];
+	size_t n = ::fread(header , 1 , 4 , in);
+	if (n == 0)
+	{
+		::fclose(in);
+		return true ;
+	}
+	if (memcmp(header , "FLZ1" , n) != 0)
+	{
+		::fclose(in);
+		return false ;
+	}
+	//文件头都没写完,从头开始
+	if (n != 4)
+	{
+		::fclose(in);
+		return true ;
+	}
+
+	//只读块头,跳过数据
+	boost::uint64_t pos = 4 ;
+	*valid_length = pos ;
+	for (;;)
+	{
+		if (::fread(header , 1 , 8 , in) != 8)
+			break ;
+		u32 raw_len = get32(header);
+		u32 packed_len = get32(header + 4) & ~kStoredFlag ;
+		if (raw_len == 0 || raw_len > kFileBlockSize || packed_len > compress_bound(kFileBlockSize))
+			break ;
+		//用读最后一个字节确认块是完整的
+		if (packed_len > 0)
+		{
+			byte last ;
+			if (::fseek(in , static_cast<long>(packed_len - 1) , SEEK_CUR) != 0 || ::fread(&last , 1 , 1 , in) != 1)
+				break ;
+		}
+		pos += 8 + packed_len ;
+		*valid_length = pos ;
+	}
+	::fclose(in);
+	return true ;
+}
+
+bool compress_file(const std::string& src , const std::string& dst , file_result* result)
+{
+	result->bytes_in = result->bytes_out = 0 ;
+	FILE* in = ::fopen(src.c_str() , "rb");
+	if (in == NULL)
+		return false ;
+	std::string tmp = dst + ".tmp" ;
+	FILE* out = ::fopen(tmp.c_str() , "wb");
+	if (out == NULL)
+	{
+		::fclose(in);
+		return false ;
+	}
+
+	std::vector<char> raw(kFileBlockSize);
+	std::vector<char> packed(block_bound(kFileBlockSize));
+	bool ok = ::fwrite("FLZ1" , 1 , 4 , out) == 4 ;
+	result->bytes_out += 4 ;
+	while (ok)
+	{
+		size_t n = ::fread(&raw[0] , 1 , raw.size() , in);
+		if (n == 0)
+		{
+			ok = !::ferror(in);
+			break ;
+		}
+		size_t len = encode_block(&raw[0] , n , &packed[0]);
+		ok = ::fwrite(&packed[0] , 1 , len , out) == len ;
+		result->bytes_in += n ;
+		result->bytes_out += len ;
+	}
+	if (ok)
+	{
+		byte trailer[4] = { 0 , 0 , 0 , 0 };
+		ok = ::fwrite(trailer , 1 , 4 , out) == 4 && ::fflush(out) == 0 ;
+		result->bytes_out += 4 ;
+	}
+	//先落盘再改名,改名后的文件一定是完整的
+#ifdef WIN32
+	ok = ok && ::_commit(::_fileno(out)) == 0 ;
+#else
+	ok = ok && ::fsync(::fileno(out)) == 0 ;
+#endif
+	ok = (::fclose(out) == 0) && ok ;
+	::fclose(in);
+
+#ifdef WIN32
+	if (ok)
+		::remove(dst.c_str());
+#endif
+	if (!ok || ::rename(tmp.c_str() , dst.c_str()) != 0)
+	{
+		::remove(tmp.c_str());
+		return false ;
+	}
+	::remove(src.c_str());
+	return true ;
+}
+
+bool decompress_file(const std::string& src , FILE* out , bool allow_unterminated)
+{
+	FILE* in = ::fopen(src.c_str() , "rb");
+	if (in == NULL)
+		return false ;
+
+	std::vector<char> raw(kFileBlockSize);
+	std::vector<char> packed(compress_bound(kFileBlockSize));
+	byte header[8];
+	bool ok = ::fread(header , 1 , 4 , in) == 4 && memcmp(header , "FLZ1" , 4) == 0 ;
+	while (ok)
+	{
+		size_t n = ::fread(header , 1 , 4 , in);
+		if (n == 0)
+		{
+			ok = allow_unterminated ;
+			break ;
+		}
+		if (n != 4)
+		{
+			ok = false ;
+			break ;
+		}
+		u32 raw_len = get32(header);
+		if (raw_len == 0)
+			break ;
+		if (raw_len > kFileBlockSize || ::fread(header + 4 , 1 , 4 , in) != 4)
+		{
+			ok = false ;
+			break ;
+		}
+		u32 packed_len = get32(header + 4);
+		bool stored = (packed_len & kStoredFlag) != 0 ;
+		packed_len &= ~kStoredFlag ;
+		if (packed_len > packed.size() || (stored && packed_len != raw_len) ||
+			::fread(&packed[0] , 1 , packed_len , in) != packed_len)
+		{
+			ok = false ;
+			break ;
+		}
+		const char* data = &packed[0] ;
+		if (!stored)
+		{
+			if (!decompress(&packed[0] , packed_len , &raw[0] , raw_len))
+			{
+				ok = false ;
+				break ;
+			}
+			data = &raw[0] ;
+		}
+		ok = ::fwrite(data , 1 , raw_len , out) == raw_len ;
+	}
+	::fclose(in);
+	return ok ;
+}
+
+}
+}
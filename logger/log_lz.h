@@ -0,0 +1,62 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_lz.h
+file path:	logfile
+file base:	log_lz
+file ext:	h
+author:
+
+purpose:	内置的LZ77压缩,用于压缩滚动掉的日志文件。块内格式与LZ4块格式
+			相同(token、扩展长度、2字节偏移),只做贪心匹配,速度优先。
+			文件格式: "FLZ1" [块]... [0]
+			块: [原始长度 u32][压缩长度 u32,最高位为1表示未压缩][数据]
+			整数都是小端。每块独立解压,写日志时直接压缩的文件在关闭时才写结尾的0,
+			正在写或崩溃后的文件没有它,最后一个不完整的块之前的内容都能读出。
+*********************************************************************/
+#ifndef __LOG_LZ_INCLUDE__
+#define __LOG_LZ_INCLUDE__
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string>
+#include <boost/cstdint.hpp>
+
+namespace fst_log_file
+{
+namespace lz
+{
+
+	//文件中每块的最大原始长度
+	const size_t kFileBlockSize = 1024 * 1024 ;
+	const boost::uint32_t kStoredFlag = 0x80000000u ;
+
+	inline size_t compress_bound(size_t n) { return n + n / 255 + 16; }
+	inline size_t block_bound(size_t n) { return compress_bound(n) + 8; }
+
+	//dst至少要有compress_bound(n)字节,返回压缩后的长度
+	size_t compress(const char* src , size_t n , char* dst);
+	//raw_n是原始长度,数据损坏时返回false
+	bool decompress(const char* src , size_t n , char* dst , size_t raw_n);
+
+	//把不超过kFileBlockSize的n字节编码成一个块,dst至少要有block_bound(n)字节,返回块的总长度
+	size_t encode_block(const char* src , size_t n , char* dst);
+	//找出最后一个完整的块结束的位置(不含结尾标记),续写前从这里截断;不是这种格式时返回false
+	bool scan_file(const std::string& filename , boost::uint64_t* valid_length);
+
+	struct file_result
+	{
+		boost::uint64_t bytes_in ;
+		boost::uint64_t bytes_out ;
+	};
+
+	//压缩到dst.tmp,落盘后改名为dst并删除src;失败时保留src
+	bool compress_file(const std::string& src , const std::string& dst , file_result* result);
+	//解压到输出流,供tools下的解压工具使用。遇到损坏或不完整的块、或者没有结尾标记时返回false,
+	//之前的块已经写到out中。allow_unterminated为true时在块边界上结束也算完整,
+	//用于还在写或崩溃后没有关闭的文件
+	bool decompress_file(const std::string& src , FILE* out , bool allow_unterminated = false);
+
+}
+}
+
+#endif
@@ -0,0 +1,169 @@
+#include "stdafx.h"
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "log_precreate.h"
+#include "threadctrl/threadctrl.h"
+#include "threadctrl/threadctrl_ext.h"
+#ifdef WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+#include <boost/bind.hpp>
+
+namespace fst_log_file
+{
+
+file_precreator::file_precreator(const std::string& basename , const file_options& options , size_t prealloc)
+: options_(options),
+prealloc_(prealloc),
+generation_(0),
+thread_(NULL),
+running_(false),
+need_(true)
+{
+	//带上进程号,同一目录下的多个进程不会抢同一个临时文件
+	char suffix[32];
+#ifdef WIN32
+	snprintf(suffix , sizeof suffix , ".next-%d-" , ::_getpid());
+#else
+	snprintf(suffix , sizeof suffix , ".next-%d-" , static_cast<int>(::getpid()));
+#endif
+	temp_prefix_ = basename + suffix ;
+	THREADCTL_ALLOC_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+	THREADCTL_ALLOC_COND(cond_);
+}
+
+file_precreator::~file_precreator()
+{
+	stop();
+	THREADCTL_FREE_COND(cond_);
+	THREADCTL_FREE_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+}
+
+void file_precreator::start()
+{
+	running_ = true ;
+	thread_ = new boost::thread(boost::bind(&file_precreator::threadFunc , this));
+}
+
+void file_precreator::stop()
+{
+	if (thread_ == NULL)
+		return ;
+	{
+		lock_guard lock(mutex_);
+		running_ = false ;
+		THREADCTL_COND_BROADCAST(cond_);
+	}
+	thread_->join();
+	delete thread_ ;
+	thread_ = NULL ;
+
+	if (ready_)
+	{
+		ready_.reset();
+		::remove(ready_name_.c_str());
+	}
+}
+
+std::string file_precreator::temp_name(unsigned int generation) const
+{
+	char suffix[32];
+	snprintf(suffix , sizeof suffix , "%u.tmp" , generation);
+	return temp_prefix_ + suffix ;
+}
+
+file_engine_ptr file_precreator::take(const std::string& filename)
+{
+	lock_guard lock(mutex_);
+	file_engine_ptr file ;
+	if (ready_)
+	{
+		file.swap(ready_);
+		taken_name_.swap(ready_name_);
+		rename_to_ = filename ;
+		need_ = true ;
+		THREADCTL_COND_BROADCAST(cond_);
+	}
+	return file ;
+}
+
+void file_precreator::retire(const file_engine_ptr& file , const std::string& filename)
+{
+	lock_guard lock(mutex_);
+	retired_.push_back(file);
+	retired_names_.push_back(filename);
+	THREADCTL_COND_BROADCAST(cond_);
+}
+
+void file_precreator::threadFunc()
+{
+	//改名失败的文件还叫临时名字,滚动掉时用它通知
+	std::string unrenamed_temp ;
+	std::string unrenamed_name ;
+	for (;;)
+	{
+		std::vector<file_engine_ptr> retired ;
+		std::vector<std::string> retired_names ;
+		std::string taken_name ;
+		std::string rename_to ;
+		bool need ;
+		bool running ;
+		{
+			lock_guard lock(mutex_);
+			while (running_ && retired_.empty() && rename_to_.empty() && !(need_ && !ready_))
+				THREADCTL_COND_WAIT(cond_ , mutex_);
+			retired.swap(retired_);
+			retired_names.swap(retired_names_);
+			taken_name.swap(taken_name_);
+			rename_to.swap(rename_to_);
+			need = need_ && !ready_ && running_ ;
+			running = running_ ;
+		}
+
+		//取走的文件还在写,改名不影响已经打开的描述符;改名失败时日志留在临时文件里,
+		//下一个临时文件换了名字,不会删到它。
+		//同一轮里可能既取走又滚动掉同一个文件,先改名再通知,on_closed拿到的名字一定存在
+		if (!rename_to.empty() && ::rename(taken_name.c_str() , rename_to.c_str()) != 0)
+		{
+			fprintf(stderr, "file_precreator rename %s to %s failed %s\n", taken_name.c_str(), rename_to.c_str(), strerror(errno));
+			unrenamed_temp = taken_name ;
+			unrenamed_name = rename_to ;
+		}
+		for (size_t i = 0; i < retired_names.size() && !unrenamed_name.empty(); ++i)
+		{
+			if (retired_names[i] == unrenamed_name)
+			{
+				retired_names[i] = unrenamed_temp ;
+				unrenamed_name.clear();
+			}
+		}
+
+		//关闭旧文件可能要等io_uring完成或写回O_DIRECT的尾块
+		retired.clear();
+		if (on_closed_)
+		{
+			for (size_t i = 0; i < retired_names.size(); ++i)
+				on_closed_(retired_names[i]);
+		}
+
+		if (need)
+		{
+			//这个名字还没交出去过,同名的只可能是上次崩溃留下的
+			std::string name = temp_name(generation_++);
+			::remove(name.c_str());
+			file_engine_ptr file(create_file_engine(name , options_));
+			file->preallocate(prealloc_);
+			lock_guard lock(mutex_);
+			ready_ = file ;
+			ready_name_ = name ;
+			need_ = false ;
+		}
+		else if (!running)
+			break ;
+	}
+}
+
+}
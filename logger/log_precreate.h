@@ -0,0 +1,70 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_precreate.h
+file path:	logfile
+file base:	log_precreate
+file ext:	h
+author:
+
+purpose:	在后台预先创建下一个日志文件。文件先以临时名字打开并预分配,
+			rollFile时直接换上,改名和关闭旧文件都交给后台线程,
+			写文件的线程在滚动时只交换指针。
+*********************************************************************/
+#ifndef __LOG_PRECREATE_INCLUDE__
+#define __LOG_PRECREATE_INCLUDE__
+
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+#include "file_engine.h"
+
+namespace fst_log_file
+{
+
+	typedef boost::shared_ptr<file_engine> file_engine_ptr;
+
+	class file_precreator : boost::noncopyable
+	{
+	public:
+		//prealloc为每个文件预分配的字节数,一般是rollSize
+		file_precreator(const std::string& basename , const file_options& options , size_t prealloc);
+		~file_precreator();
+
+		void start();
+		//处理完已经交给后台的改名和关闭,删掉没用上的临时文件
+		void stop();
+
+		//取走准备好的文件,后台把它改名为filename后再准备下一个;还没准备好时返回空
+		file_engine_ptr take(const std::string& filename);
+		//滚动掉的文件交给后台线程关闭,关闭后用文件名调用on_closed
+		void retire(const file_engine_ptr& file , const std::string& filename);
+		void set_on_closed(const boost::function<void (const std::string&)>& on_closed) { on_closed_ = on_closed; }
+
+	private:
+		void threadFunc();
+		std::string temp_name(unsigned int generation) const;
+
+		const file_options options_;
+		const size_t prealloc_ ;
+		std::string temp_prefix_ ;
+		unsigned int generation_ ;			//每个临时文件用不同的名字,改名失败时正在写的文件不会被后面的删掉
+		void* mutex_ ;
+		void* cond_ ;
+		boost::thread* thread_ ;
+		bool running_ ;
+		bool need_ ;						//需要准备下一个文件
+		file_engine_ptr ready_ ;
+		std::string ready_name_ ;
+		std::string taken_name_ ;			//已经被取走的临时文件
+		std::string rename_to_ ;			//已经被取走的临时文件的正式名字
+		std::vector<file_engine_ptr> retired_ ;
+		std::vector<std::string> retired_names_ ;
+		boost::function<void (const std::string&)> on_closed_ ;
+	};
+
+}
+
+#endif
@@ -0,0 +1,79 @@
+#include "stdafx.h"
+#include "log_rcu.h"
+
+namespace fst_log_file
+{
+
+rcu_domain::rcu_domain()
+{
+	epoch_.store(1);
+	readers_lock_.store(false);
+}
+
+rcu_domain::reader* rcu_domain::this_reader()
+{
+	reader_holder* holder = holder_.get();
+	if (holder == NULL)
+	{
+		ReaderPtr r(new reader);
+		{
+			spin_guard lock(readers_lock_);
+			readers_.push_back(r);
+		}
+		holder = new reader_holder(r);
+		holder_.reset(holder);
+	}
+	return holder->self.get();
+}
+
+rcu_domain::reader* rcu_domain::read_lock()
+{
+	reader* self = this_reader();
+	if (self->nesting++ == 0)
+	{
+		self->epoch.store(epoch_.load(boost::memory_order_relaxed) , boost::memory_order_relaxed);
+		//登记要在读取受保护的指针之前对写者可见,和synchronize里的fence配对
+		boost::atomic_thread_fence(boost::memory_order_seq_cst);
+	}
+	return self ;
+}
+
+void rcu_domain::read_unlock(reader* self)
+{
+	if (--self->nesting == 0)
+		self->epoch.store(0 , boost::memory_order_release);
+}
+
+void rcu_domain::synchronize()
+{
+	//新数据已经发布,之后登记的读者一定能看到它
+	boost::uint64_t target = epoch_.fetch_add(1 , boost::memory_order_seq_cst) + 1 ;
+	boost::atomic_thread_fence(boost::memory_order_seq_cst);
+
+	std::vector<ReaderPtr> readers ;
+	{
+		spin_guard lock(readers_lock_);
+		//已经退出的线程不会再进入临界区
+		size_t kept = 0 ;
+		for (size_t i = 0; i < readers_.size(); ++i)
+		{
+			if (!readers_[i]->retired.load(boost::memory_order_acquire))
+				readers_[kept++] = readers_[i];
+		}
+		readers_.resize(kept);
+		readers = readers_ ;
+	}
+
+	for (size_t i = 0; i < readers.size(); ++i)
+	{
+		for (;;)
+		{
+			boost::uint64_t epoch = readers[i]->epoch.load(boost::memory_order_acquire);
+			if (epoch == 0 || epoch >= target)
+				break ;
+			boost::this_thread::yield();
+		}
+	}
+}
+
+}
@@ -0,0 +1,96 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_rcu.h
+file path:	logfile
+file base:	log_rcu
+file ext:	h
+author:
+
+purpose:	读多写少的数据用的简单RCU。读者进入临界区时在本线程的槽位里
+			登记当前纪元,离开时清零,不加锁,只写自己的缓存行;写者换上
+			新数据后推进纪元,等登记了旧纪元的读者都离开,再释放旧数据。
+*********************************************************************/
+#ifndef __LOG_RCU_INCLUDE__
+#define __LOG_RCU_INCLUDE__
+
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/atomic.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+namespace fst_log_file
+{
+
+	//自旋锁,用于很少发生、又可能早于threadctl初始化的操作
+	class spin_guard : boost::noncopyable
+	{
+	public:
+		explicit spin_guard(boost::atomic<bool>& lock) : lock_(lock)
+		{
+			while(lock_.exchange(true , boost::memory_order_acquire))
+				boost::this_thread::yield();
+		}
+		~spin_guard() { lock_.store(false , boost::memory_order_release); }
+
+	private:
+		boost::atomic<bool>& lock_ ;
+	};
+
+	class rcu_domain : boost::noncopyable
+	{
+	public:
+		//每个读线程一个,独占一个缓存行
+		struct reader : boost::noncopyable
+		{
+			reader() : nesting(0)
+			{
+				epoch.store(0);
+				retired.store(false);
+			}
+			boost::atomic<boost::uint64_t> epoch ;	//0表示不在临界区
+			int nesting ;
+			boost::atomic<bool> retired ;			//线程已经退出
+			char pad[64] ;
+		};
+
+		rcu_domain();
+
+		//可以嵌套,返回值交给read_unlock
+		reader* read_lock();
+		void read_unlock(reader* self);
+		//等调用之前进入临界区的读者全部离开,由写者在换下旧数据后调用
+		void synchronize();
+
+	private:
+		typedef boost::shared_ptr<reader> ReaderPtr;
+		struct reader_holder
+		{
+			explicit reader_holder(const ReaderPtr& r) : self(r) {}
+			~reader_holder() { self->retired.store(true , boost::memory_order_release); }
+			ReaderPtr self ;
+		};
+
+		reader* this_reader();
+
+		boost::atomic<boost::uint64_t> epoch_ ;
+		boost::atomic<bool> readers_lock_ ;
+		std::vector<ReaderPtr> readers_ ;
+		boost::thread_specific_ptr<reader_holder> holder_ ;
+	};
+
+	class rcu_read_guard : boost::noncopyable
+	{
+	public:
+		explicit rcu_read_guard(rcu_domain& domain) : domain_(domain) , self_(domain.read_lock()) {}
+		~rcu_read_guard() { domain_.read_unlock(self_); }
+
+	private:
+		rcu_domain& domain_ ;
+		rcu_domain::reader* const self_ ;
+	};
+
+}
+
+#endif
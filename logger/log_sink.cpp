@@ -0,0 +1,596 @@
+#include "stdafx.h"
+#include <string.h>
+#include <algorithm>
+#include <new>
+#include "log_sink.h"
+#include "threadctrl/threadctrl.h"
+#include "threadctrl/threadctrl_ext.h"
+#ifdef WIN32
+#include <io.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+#include <boost/bind.hpp>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL	0
+#endif
+
+namespace fst_log_file
+{
+
+log_record* log_record::create(LogLevel level , const char* data , int len)
+{
+	void* p = ::operator new(sizeof(log_record) + len);
+	log_record* record = new (p) log_record(level , len);
+	memcpy(record->data_ , data , len);
+	return record ;
+}
+
+void log_record::destroy(log_record* record)
+{
+	record->~log_record();
+	::operator delete(record);
+}
+
+void log_sink::get_stats(sink_stats* stats)
+{
+	stats->name = name_ ;
+	stats->records = stats->bytes = stats->queue_depth = 0 ;
+	stats->dropped = oversized_.load(boost::memory_order_relaxed);
+}
+
+memory_sink::memory_sink(const std::string& name , size_t capacity)
+: log_sink(name),
+ring_(capacity < 1 ? 1 : capacity),
+next_(0),
+records_(0),
+bytes_(0)
+{
+	THREADCTL_ALLOC_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+}
+
+memory_sink::~memory_sink()
+{
+	THREADCTL_FREE_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+}
+
+void memory_sink::write(log_record_ref& record)
+{
+	log_record_ptr shared = record.share();
+	lock_guard lock(mutex_);
+	//被挤出去的旧记录在这里释放,最后一个引用者负责删除
+	ring_[next_].swap(shared);
+	next_ = (next_ + 1) % ring_.size();
+	++records_ ;
+	bytes_ += record.length();
+}
+
+void memory_sink::get_stats(sink_stats* stats)
+{
+	log_sink::get_stats(stats);
+	lock_guard lock(mutex_);
+	stats->records = records_ ;
+	stats->bytes = bytes_ ;
+}
+
+void memory_sink::snapshot(std::vector<log_record_ptr>* records) const
+{
+	records->clear();
+	lock_guard lock(mutex_);
+	for (size_t i = 0; i < ring_.size(); ++i)
+	{
+		const log_record_ptr& record = ring_[(next_ + i) % ring_.size()];
+		if (record)
+			records->push_back(record);
+	}
+}
+
+void memory_sink::dump(FILE* out) const
+{
+	std::vector<log_record_ptr> records ;
+	snapshot(&records);
+	for (size_t i = 0; i < records.size(); ++i)
+		fwrite(records[i]->data() , 1 , records[i]->length() , out);
+	fflush(out);
+}
+
+
+queued_sink::queued_sink(const std::string& name , size_t max_queue , int flush_interval_ms)
+: log_sink(name),
+max_queue_(max_queue < 1 ? 1 : max_queue),
+flush_interval_ms_(flush_interval_ms),
+running_(false),
+thread_(NULL)
+{
+	dropped_.store(0);
+	THREADCTL_ALLOC_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+	THREADCTL_ALLOC_COND(cond_);
+}
+
+queued_sink::~queued_sink()
+{
+	stop();
+	THREADCTL_FREE_COND(cond_);
+	THREADCTL_FREE_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+}
+
+void queued_sink::start()
+{
+	running_ = true ;
+	thread_ = new boost::thread(boost::bind(&queued_sink::threadFunc , this));
+}
+
+void queued_sink::stop()
+{
+	if (thread_ == NULL)
+		return ;
+	{
+		lock_guard lock(mutex_);
+		running_ = false ;
+		THREADCTL_COND_SIGNAL(cond_);
+	}
+	thread_->join();
+	delete thread_ ;
+	thread_ = NULL ;
+}
+
+void queued_sink::write(log_record_ref& record)
+{
+	{
+		lock_guard lock(mutex_);
+		if (queue_.size() < max_queue_)
+		{
+			queue_.push_back(record.share());
+			//写线程取走整个队列,只有空变非空时它才可能在等
+			if (queue_.size() == 1)
+				THREADCTL_COND_SIGNAL(cond_);
+			return ;
+		}
+	}
+	dropped_.fetch_add(1 , boost::memory_order_relaxed);
+}
+
+void queued_sink::get_stats(sink_stats* stats)
+{
+	log_sink::get_stats(stats);
+	stats->records = records_.get();
+	stats->bytes = bytes_.get();
+	stats->dropped += dropped_.load(boost::memory_order_relaxed);
+	lock_guard lock(mutex_);
+	stats->queue_depth = queue_.size();
+}
+
+void queued_sink::count_sent(const log_record_ptr* records , size_t count , size_t sent)
+{
+	boost::uint64_t bytes = 0 ;
+	for (size_t i = 0; i < sent; ++i)
+		bytes += records[i]->length();
+	count_written(sent , bytes);
+	count_dropped(count - sent);
+}
+
+void queued_sink::count_written(size_t records , boost::uint64_t bytes)
+{
+	records_.add(records);
+	bytes_.add(bytes);
+}
+
+void queued_sink::count_dropped(size_t records)
+{
+	if (records > 0)
+		dropped_.fetch_add(records , boost::memory_order_relaxed);
+}
+
+void queued_sink::threadFunc()
+{
+	std::vector<log_record_ptr> batch ;
+	bool dirty = false ;	//write_batch之后还没有flush
+	for (;;)
+	{
+		{
+			lock_guard lock(mutex_);
+			if (dirty && flush_interval_ms_ > 0)
+			{
+				if (running_ && queue_.empty())
+				{
+					timeval wait_time ;
+					wait_time.tv_sec = flush_interval_ms_ / 1000 ;
+					wait_time.tv_usec = (flush_interval_ms_ % 1000) * 1000 ;
+					THREADCTL_COND_WAIT_TIMED(cond_ , mutex_ , &wait_time);
+				}
+			}
+			else
+			{
+				while (running_ && queue_.empty())
+					THREADCTL_COND_WAIT(cond_ , mutex_);
+			}
+			if (!running_ && queue_.empty())
+				break ;
+			batch.swap(queue_);
+		}
+
+		if (batch.empty())
+		{
+			//空闲了flush_interval_ms
+			flush();
+			dirty = false ;
+			continue ;
+		}
+
+		write_batch(&batch[0] , batch.size());
+		dirty = true ;
+		//记录在这里释放,容量留给下一轮交换
+		batch.clear();
+	}
+	flush();
+}
+
+
+//标准输出攒够这么多再写
+static const size_t kConsoleBuffer = 64 * 1024 ;
+static const int kStdoutFd = 1 ;
+static const char* const kLevelColor[NULL_LEVEL] = { "\033[90m" , "" , "\033[33m" , "\033[31m" };
+static const char kColorReset[] = "\033[0m" ;
+
+std::string console_options::key() const
+{
+	char key[64];
+	snprintf(key , sizeof key , "%lu|%d|%d" , (unsigned long)queue_size , static_cast<int>(color) , nonblock ? 1 : 0);
+	return key ;
+}
+
+static bool stdout_is_tty()
+{
+#ifdef WIN32
+	return ::_isatty(kStdoutFd) != 0 ;
+#else
+	return ::isatty(kStdoutFd) != 0 ;
+#endif
+}
+
+console_sink::console_sink(const console_options& options)
+: queued_sink("console" , options.queue_size , 1000),
+tty_(stdout_is_tty()),
+color_(options.color == CONSOLE_COLOR_ON || (options.color == CONSOLE_COLOR_AUTO && tty_)),
+nonblock_(options.nonblock),
+staging_(kConsoleBuffer),
+staged_(0),
+staged_since_(0)
+{
+}
+
+console_sink::~console_sink()
+{
+	//写线程还会调用write_batch和flush,要在成员析构之前停止
+	stop();
+}
+
+void console_sink::write_batch(const log_record_ptr* records , size_t count)
+{
+	for (size_t i = 0; i < count; ++i)
+	{
+		const log_record& record = *records[i];
+		const char* color = color_ ? kLevelColor[record.level()] : "" ;
+		size_t color_len = strlen(color);
+		size_t reset_len = color_len > 0 ? sizeof kColorReset - 1 : 0 ;
+		size_t size = color_len + record.length() + reset_len ;
+		if (staged_ + size > staging_.size())
+			flush();
+		if (staged_ == 0)
+			staged_since_ = ::time(NULL);
+
+		//颜色在行尾换行符之前复位,按行读的程序不会多出一行
+		size_t body = record.length();
+		while (reset_len > 0 && body > 0 && (record.data()[body - 1] == '\n' || record.data()[body - 1] == '\r'))
+			--body ;
+		char* p = &staging_[staged_];
+		memcpy(p , color , color_len);
+		p += color_len ;
+		memcpy(p , record.data() , body);
+		p += body ;
+		memcpy(p , kColorReset , reset_len);
+		p += reset_len ;
+		memcpy(p , record.data() + body , record.length() - body);
+		staged_ += size ;
+		ends_.push_back(staged_);
+		payload_ends_.push_back((payload_ends_.empty() ? 0 : payload_ends_.back()) + record.length());
+	}
+
+	//终端前有人在看,每批都写;管道和文件攒满再写,但最多攒一秒
+	if (tty_ || ::time(NULL) - staged_since_ >= 1)
+		flush();
+}
+
+void console_sink::flush()
+{
+	if (staged_ == 0)
+		return ;
+
+	size_t written = write_out(&staging_[0] , staged_);
+	//只有写完整的记录算写出
+	size_t sent = std::upper_bound(ends_.begin() , ends_.end() , written) - ends_.begin();
+	count_written(sent , sent > 0 ? payload_ends_[sent - 1] : 0);
+	count_dropped(ends_.size() - sent);
+	staged_ = 0 ;
+	ends_.clear();
+	payload_ends_.clear();
+}
+
+//返回写出的字节数。nonblock时每次只写PIPE_BUF以内的整条记录,
+//读端有空间时这样的write不会阻塞,也不会只写一半;没有空间时放弃剩下的
+size_t console_sink::write_out(const char* data , size_t len)
+{
+	size_t done = 0 ;
+	while (done < len)
+	{
+		size_t end = len ;
+#ifndef WIN32
+		if (nonblock_)
+		{
+			struct pollfd pfd ;
+			pfd.fd = kStdoutFd ;
+			pfd.events = POLLOUT ;
+			pfd.revents = 0 ;
+			if (::poll(&pfd , 1 , 0) <= 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL)))
+				break ;
+			std::vector<size_t>::const_iterator it = std::upper_bound(ends_.begin() , ends_.end() , done + PIPE_BUF);
+			if (it != ends_.begin() && *(it - 1) > done)
+				end = *(it - 1);
+			else
+				end = *std::upper_bound(ends_.begin() , ends_.end() , done);
+		}
+		ssize_t ret = ::write(kStdoutFd , data + done , end - done);
+		if (ret < 0 && errno == EINTR)
+			continue ;
+#else
+		int ret = ::_write(kStdoutFd , data + done , static_cast<unsigned int>(end - done));
+#endif
+		if (ret <= 0)
+			break ;
+		done += ret ;
+	}
+	return done ;
+}
+
+
+#ifndef WIN32
+
+//写线程阻塞在对端上时最多等这么久,stop()不会一直卡住
+static void set_send_timeout(int fd)
+{
+	struct timeval tv ;
+	tv.tv_sec = 1 ;
+	tv.tv_usec = 0 ;
+	::setsockopt(fd , SOL_SOCKET , SO_SNDTIMEO , &tv , sizeof tv);
+}
+
+unix_dgram_sink::unix_dgram_sink(const std::string& name , size_t max_queue , const std::string& path)
+: queued_sink(name , max_queue),
+path_(path),
+fd_(-1)
+{
+}
+
+unix_dgram_sink::~unix_dgram_sink()
+{
+	//写线程还会调用write_batch,要在成员析构之前停止
+	stop();
+	if (fd_ >= 0)
+		::close(fd_);
+}
+
+bool unix_dgram_sink::connect_socket()
+{
+	struct sockaddr_un addr ;
+	if (path_.size() >= sizeof addr.sun_path)
+		return false ;
+	memset(&addr , 0 , sizeof addr);
+	addr.sun_family = AF_UNIX ;
+	memcpy(addr.sun_path , path_.c_str() , path_.size());
+
+	fd_ = ::socket(AF_UNIX , SOCK_DGRAM , 0);
+	if (fd_ < 0)
+		return false ;
+	::fcntl(fd_ , F_SETFD , FD_CLOEXEC);
+	set_send_timeout(fd_);
+	if (::connect(fd_ , reinterpret_cast<struct sockaddr*>(&addr) , sizeof addr) != 0)
+	{
+		::close(fd_);
+		fd_ = -1 ;
+		return false ;
+	}
+	return true ;
+}
+
+void unix_dgram_sink::write_batch(const log_record_ptr* records , size_t count)
+{
+	if (fd_ < 0 && !connect_socket())
+	{
+		count_dropped(count);
+		return ;
+	}
+
+	size_t sent = 0 ;
+	while (sent < count)
+	{
+#ifdef __linux__
+		//一次系统调用发多个数据报
+		const size_t kMaxMessages = 64 ;
+		struct mmsghdr msgs[kMaxMessages];
+		struct iovec vec[kMaxMessages];
+		size_t n = std::min(count - sent , kMaxMessages);
+		memset(msgs , 0 , sizeof(msgs[0]) * n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			vec[i].iov_base = const_cast<char*>(records[sent + i]->data());
+			vec[i].iov_len = records[sent + i]->length();
+			msgs[i].msg_hdr.msg_iov = &vec[i];
+			msgs[i].msg_hdr.msg_iovlen = 1 ;
+		}
+		int ret = ::sendmmsg(fd_ , msgs , static_cast<unsigned int>(n) , MSG_NOSIGNAL);
+#else
+		int ret = ::send(fd_ , records[sent]->data() , records[sent]->length() , MSG_NOSIGNAL) < 0 ? -1 : 1 ;
+#endif
+		if (ret > 0)
+		{
+			sent += ret ;
+			continue ;
+		}
+		if (ret < 0 && errno == EINTR)
+			continue ;
+		//对端退出或重建了socket,下一批重新连接
+		if (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS)
+		{
+			::close(fd_);
+			fd_ = -1 ;
+		}
+		break ;
+	}
+	count_sent(records , count , sent);
+}
+
+
+tcp_sink::tcp_sink(const std::string& name , size_t max_queue ,
+	const std::string& host , const std::string& port)
+: queued_sink(name , max_queue),
+host_(host),
+port_(port),
+fd_(-1),
+last_attempt_(0)
+{
+}
+
+tcp_sink::~tcp_sink()
+{
+	stop();
+	if (fd_ >= 0)
+		::close(fd_);
+}
+
+bool tcp_sink::connect_socket()
+{
+	time_t now = ::time(NULL);
+	if (now == last_attempt_)
+		return false ;
+	last_attempt_ = now ;
+
+	struct addrinfo hints ;
+	memset(&hints , 0 , sizeof hints);
+	hints.ai_family = AF_UNSPEC ;
+	hints.ai_socktype = SOCK_STREAM ;
+	struct addrinfo* result = NULL ;
+	if (::getaddrinfo(host_.c_str() , port_.c_str() , &hints , &result) != 0)
+		return false ;
+
+	for (struct addrinfo* ai = result; ai != NULL && fd_ < 0; ai = ai->ai_next)
+	{
+		fd_ = ::socket(ai->ai_family , ai->ai_socktype , ai->ai_protocol);
+		if (fd_ < 0)
+			continue ;
+		::fcntl(fd_ , F_SETFD , FD_CLOEXEC);
+		set_send_timeout(fd_);
+		if (::connect(fd_ , ai->ai_addr , ai->ai_addrlen) != 0)
+		{
+			::close(fd_);
+			fd_ = -1 ;
+		}
+	}
+	::freeaddrinfo(result);
+	return fd_ >= 0 ;
+}
+
+//写不完时调整vec继续写,出错返回false
+bool tcp_sink::send_all(log_iovec* vec , int count)
+{
+	while (count > 0)
+	{
+		struct msghdr msg ;
+		memset(&msg , 0 , sizeof msg);
+		msg.msg_iov = vec ;
+		msg.msg_iovlen = count ;
+		ssize_t n = ::sendmsg(fd_ , &msg , MSG_NOSIGNAL);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue ;
+			return false ;
+		}
+		size_t left = static_cast<size_t>(n);
+		while (count > 0 && left >= vec->iov_len)
+		{
+			left -= vec->iov_len ;
+			++vec ;
+			--count ;
+		}
+		if (count > 0)
+		{
+			vec->iov_base = static_cast<char*>(vec->iov_base) + left ;
+			vec->iov_len -= left ;
+		}
+	}
+	return true ;
+}
+
+void tcp_sink::write_batch(const log_record_ptr* records , size_t count)
+{
+	if (fd_ < 0 && !connect_socket())
+	{
+		count_dropped(count);
+		return ;
+	}
+
+	const size_t kMaxIov = 1024 ;
+	size_t sent = 0 ;
+	while (sent < count)
+	{
+		size_t n = std::min(count - sent , kMaxIov);
+		iov_.resize(n);
+		for (size_t i = 0; i < n; ++i)
+		{
+			iov_[i].iov_base = const_cast<char*>(records[sent + i]->data());
+			iov_[i].iov_len = records[sent + i]->length();
+		}
+		if (!send_all(&iov_[0] , static_cast<int>(n)))
+		{
+			//只写了一半的记录会让对端的行错位,断开重连
+			::close(fd_);
+			fd_ = -1 ;
+			break ;
+		}
+		sent += n ;
+	}
+	count_sent(records , count , sent);
+}
+
+#endif
+
+
+std::string sink_options::key() const
+{
+	char sizes[64];
+	snprintf(sizes , sizeof sizes , "|%lu|%lu|" , (unsigned long)queue_size , (unsigned long)records);
+	return type + "|" + name + sizes + path + "|" + host + "|" + port ;
+}
+
+log_sink* create_sink(const sink_options& options)
+{
+	if (options.type == "memory")
+		return new memory_sink(options.name , options.records);
+#ifndef WIN32
+	if (options.type == "unix_dgram")
+		return new unix_dgram_sink(options.name , options.queue_size , options.path);
+	if (options.type == "tcp")
+		return new tcp_sink(options.name , options.queue_size , options.host , options.port);
+#endif
+	return NULL ;
+}
+
+}
@@ -0,0 +1,316 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_sink.h
+file path:	logfile
+file base:	log_sink
+file ext:	h
+author:
+
+purpose:	日志的输出目的。logger把格式化好的一条日志依次交给级别满足的
+			各个sink;需要排队异步写的sink共用同一份带引用计数的记录,
+			不会每个目的各复制一次。
+*********************************************************************/
+#ifndef __LOG_SINK_INCLUDE__
+#define __LOG_SINK_INCLUDE__
+
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/intrusive_ptr.hpp>
+#include "log_stats.h"
+#include "file_engine.h"
+
+namespace fst_log_file
+{
+
+	enum LogLevel
+	{
+		DEBUG_LEVEL =0,
+		INFO_LEVEL,
+		WARN_LEVEL,
+		ERR_LEVEL,
+		NULL_LEVEL
+	};
+
+	//sink收到的记录格式
+	enum RecordFormat
+	{
+		FORMAT_TEXT = 0,	//"时间,级别,消息"
+		FORMAT_JSON,		//每行一个JSON对象
+		FORMAT_LOGFMT,		//key=value,空格分隔
+		FORMAT_COUNT
+	};
+
+	//格式化好的一条日志,创建后不再修改,各sink的写线程共用
+	class log_record : boost::noncopyable
+	{
+	public:
+		static log_record* create(LogLevel level , const char* data , int len);
+
+		LogLevel level() const { return level_; }
+		const char* data() const { return data_; }
+		int length() const { return len_; }
+
+		friend void intrusive_ptr_add_ref(log_record* record)
+		{
+			record->refs_.fetch_add(1 , boost::memory_order_relaxed);
+		}
+		friend void intrusive_ptr_release(log_record* record)
+		{
+			if (record->refs_.fetch_sub(1 , boost::memory_order_release) == 1)
+			{
+				boost::atomic_thread_fence(boost::memory_order_acquire);
+				destroy(record);
+			}
+		}
+
+	private:
+		log_record(LogLevel level , int len) : refs_(0) , level_(level) , len_(len) {}
+		static void destroy(log_record* record);
+
+		boost::atomic<int> refs_ ;
+		const LogLevel level_ ;
+		const int len_ ;
+		char data_[1] ;		//实际长度为len_,和记录头一起分配
+	};
+	typedef boost::intrusive_ptr<log_record> log_record_ptr;
+
+	//调用线程栈上的一条日志,第一个需要保留它的sink才复制到堆上
+	class log_record_ref : boost::noncopyable
+	{
+	public:
+		log_record_ref(LogLevel level , const char* data , int len , size_t shard_key = 0 , RecordFormat format = FORMAT_TEXT)
+			: level_(level) , data_(data) , len_(len) , shard_key_(shard_key) , format_(format) {}
+
+		LogLevel level() const { return level_; }
+		const char* data() const { return data_; }
+		int length() const { return len_; }
+		//分片写文件时按它选分片,0表示按调用线程
+		size_t shard_key() const { return shard_key_; }
+		RecordFormat format() const { return format_; }
+
+		const log_record_ptr& share()
+		{
+			if (!shared_)
+				shared_.reset(log_record::create(level_ , data_ , len_));
+			return shared_;
+		}
+
+	private:
+		const LogLevel level_ ;
+		const char* const data_ ;
+		const int len_ ;
+		const size_t shard_key_ ;
+		const RecordFormat format_ ;
+		log_record_ptr shared_ ;
+	};
+
+	struct sink_stats
+	{
+		std::string name ;
+		boost::uint64_t records ;	//已经写出的
+		boost::uint64_t bytes ;
+		boost::uint64_t dropped ;	//队列满、写出失败或编码后太长丢掉的
+		boost::uint64_t queue_depth ;	//已进入队列还没有写出的
+	};
+
+	class log_sink : boost::noncopyable
+	{
+	public:
+		explicit log_sink(const std::string& name) : name_(name) { oversized_.store(0); }
+		virtual ~log_sink() {}
+
+		const std::string& name() const { return name_; }
+
+		virtual void start() {}
+		//写完已经接收的日志后返回
+		virtual void stop() {}
+		//在调用日志的线程里执行,不能阻塞
+		virtual void write(log_record_ref& record) = 0;
+		virtual void get_stats(sink_stats* stats);
+		//记录转换成这个sink的格式后超过MAX_LOG_BUFFER_SIZE,没有交给它就丢掉了
+		void count_oversized() { oversized_.fetch_add(1 , boost::memory_order_relaxed); }
+
+	private:
+		const std::string name_ ;
+		boost::atomic<boost::uint64_t> oversized_ ;
+	};
+
+	//只在内存中保留最近的若干条,供出错时dump
+	class memory_sink : public log_sink
+	{
+	public:
+		memory_sink(const std::string& name , size_t capacity);
+		~memory_sink();
+
+		void write(log_record_ref& record);
+		void get_stats(sink_stats* stats);
+		//按写入顺序取出当前保留的记录
+		void snapshot(std::vector<log_record_ptr>* records) const ;
+		void dump(FILE* out) const ;
+
+	private:
+		void* mutex_ ;
+		std::vector<log_record_ptr> ring_ ;
+		size_t next_ ;
+		boost::uint64_t records_ ;
+		boost::uint64_t bytes_ ;
+	};
+
+	//有自己的写线程的sink:调用线程只把记录的引用放进有界队列,
+	//写线程每次取走队列里的全部记录,交给write_batch一起写
+	class queued_sink : public log_sink
+	{
+	public:
+		//flush_interval_ms不为0时,写线程在write_batch之后空闲这么久就调用flush
+		queued_sink(const std::string& name , size_t max_queue , int flush_interval_ms = 0);
+		~queued_sink();
+
+		void start();
+		void stop();
+		//队列满时丢弃这一条并计数
+		void write(log_record_ref& record);
+		void get_stats(sink_stats* stats);
+
+	protected:
+		//在写线程里调用,用count_sent或count_written/count_dropped计数
+		virtual void write_batch(const log_record_ptr* records , size_t count) = 0;
+		//写出攒着的数据,停止前也会调用
+		virtual void flush() {}
+
+		//写出了前sent条,其余的计入丢弃
+		void count_sent(const log_record_ptr* records , size_t count , size_t sent);
+		void count_written(size_t records , boost::uint64_t bytes);
+		void count_dropped(size_t records);
+
+	private:
+		void threadFunc();
+
+		const size_t max_queue_ ;
+		const int flush_interval_ms_ ;
+		void* mutex_ ;
+		void* cond_ ;
+		bool running_ ;
+		std::vector<log_record_ptr> queue_ ;
+		boost::thread* thread_ ;
+
+		boost::atomic<boost::uint64_t> dropped_ ;
+		stat_counter records_ ;
+		stat_counter bytes_ ;
+	};
+
+	enum ConsoleColor
+	{
+		CONSOLE_COLOR_OFF = 0,
+		CONSOLE_COLOR_ON,
+		CONSOLE_COLOR_AUTO,		//标准输出是终端时才加颜色
+	};
+
+	struct console_options
+	{
+		console_options() : queue_size(8192) , color(CONSOLE_COLOR_OFF) , nonblock(false) {}
+
+		//这些都相同时,重新加载配置沿用原来的sink
+		std::string key() const ;
+
+		size_t queue_size ;
+		ConsoleColor color ;	//按级别加ANSI颜色
+		bool nonblock ;			//读端来不及读时丢弃并计数,不阻塞写线程
+	};
+
+	//标准输出。写线程把记录攒进缓冲区,用write(2)成批写fd 1,不经过stdio的锁;
+	//标准输出是终端时每批写一次,否则攒满缓冲区或者超过一秒才写
+	class console_sink : public queued_sink
+	{
+	public:
+		explicit console_sink(const console_options& options = console_options());
+		~console_sink();
+
+	protected:
+		void write_batch(const log_record_ptr* records , size_t count);
+		void flush();
+
+	private:
+		size_t write_out(const char* data , size_t len);
+
+		const bool tty_ ;
+		const bool color_ ;
+		const bool nonblock_ ;
+		std::vector<char> staging_ ;
+		size_t staged_ ;
+		std::vector<size_t> ends_ ;		//staging_中每条记录的结束位置
+		std::vector<size_t> payload_ends_ ;	//到每条记录为止的日志字节数,不含颜色,用于计数
+		time_t staged_since_ ;
+	};
+
+#ifndef WIN32
+	//每条日志作为一个数据报发给本机的unix socket,对端不在时丢弃
+	class unix_dgram_sink : public queued_sink
+	{
+	public:
+		unix_dgram_sink(const std::string& name , size_t max_queue , const std::string& path);
+		~unix_dgram_sink();
+
+	protected:
+		void write_batch(const log_record_ptr* records , size_t count);
+
+	private:
+		bool connect_socket();
+
+		const std::string path_ ;
+		int fd_ ;
+	};
+
+	//用一条TCP长连接发给本机的日志收集程序,断开后每隔一秒重连一次,
+	//断开期间的日志丢弃
+	class tcp_sink : public queued_sink
+	{
+	public:
+		tcp_sink(const std::string& name , size_t max_queue ,
+			const std::string& host , const std::string& port);
+		~tcp_sink();
+
+	protected:
+		void write_batch(const log_record_ptr* records , size_t count);
+
+	private:
+		bool connect_socket();
+		bool send_all(log_iovec* vec , int count);
+
+		const std::string host_ ;
+		const std::string port_ ;
+		int fd_ ;
+		time_t last_attempt_ ;
+		std::vector<log_iovec> iov_ ;
+	};
+#endif
+
+	//logconfig里<sinks>下的一个<sink>
+	struct sink_options
+	{
+		sink_options() : level(DEBUG_LEVEL) , format(FORMAT_TEXT) , queue_size(8192) , records(1024) {}
+
+		//这些都相同时,重新加载配置沿用原来的sink,不丢已经排队的日志
+		std::string key() const ;
+
+		std::string type ;
+		std::string name ;
+		LogLevel level ;
+		RecordFormat format ;	//重新加载时可以改变,不影响沿用sink
+		size_t queue_size ;
+		size_t records ;	//memory
+		std::string path ;	//unix_dgram
+		std::string host ;	//tcp
+		std::string port ;
+	};
+
+	//类型不认识或者本平台不支持时返回NULL
+	log_sink* create_sink(const sink_options& options);
+
+}
+
+#endif
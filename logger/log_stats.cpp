@@ -0,0 +1,72 @@
+#include "stdafx.h"
+#include <string.h>
+#include <time.h>
+#include "log_stats.h"
+
+namespace fst_log_file
+{
+
+void histogram_snapshot::clear()
+{
+	memset(this , 0 , sizeof(*this));
+}
+
+void histogram_snapshot::merge(const histogram_snapshot& other)
+{
+	for (int i = 0; i < LOG_HISTOGRAM_BUCKETS; ++i)
+		buckets[i] += other.buckets[i];
+	count += other.count ;
+	sum_ns += other.sum_ns ;
+	if (other.max_ns > max_ns)
+		max_ns = other.max_ns ;
+}
+
+boost::uint64_t histogram_snapshot::percentile(double p) const
+{
+	if (count == 0)
+		return 0 ;
+
+	boost::uint64_t target = static_cast<boost::uint64_t>(p * count);
+	if (target >= count)
+		target = count - 1 ;
+
+	boost::uint64_t seen = 0 ;
+	for (int i = 0; i < LOG_HISTOGRAM_BUCKETS; ++i)
+	{
+		seen += buckets[i] ;
+		if (seen > target)
+		{
+			boost::uint64_t upper = static_cast<boost::uint64_t>(2) << i ;
+			return upper < max_ns ? upper : max_ns ;
+		}
+	}
+	return max_ns ;
+}
+
+void latency_histogram::snapshot(histogram_snapshot* out) const
+{
+	for (int i = 0; i < LOG_HISTOGRAM_BUCKETS; ++i)
+		out->buckets[i] = buckets_[i].get();
+	out->count = count_.get();
+	out->sum_ns = sum_ns_.get();
+	out->max_ns = max_ns_.get();
+}
+
+boost::uint64_t stats_now_ns()
+{
+#ifdef WIN32
+	static LARGE_INTEGER freq = { 0 };
+	if (freq.QuadPart == 0)
+		::QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER now ;
+	::QueryPerformanceCounter(&now);
+	return static_cast<boost::uint64_t>(now.QuadPart / freq.QuadPart) * 1000000000ULL +
+		static_cast<boost::uint64_t>(now.QuadPart % freq.QuadPart) * 1000000000ULL / freq.QuadPart ;
+#else
+	struct timespec ts ;
+	::clock_gettime(CLOCK_MONOTONIC , &ts);
+	return static_cast<boost::uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec ;
+#endif
+}
+
+}
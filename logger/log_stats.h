@@ -0,0 +1,104 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_stats.h
+file path:	logfile
+file base:	log_stats
+file ext:	h
+author:
+
+purpose:	日志管线的运行统计。计数器和耗时直方图都只由一个线程写,
+			写入只是普通的读加写,不需要带锁前缀的原子指令;
+			其他线程随时可以读,读到的是一个近似一致的快照。
+*********************************************************************/
+#ifndef __LOG_STATS_INCLUDE__
+#define __LOG_STATS_INCLUDE__
+
+#include <boost/utility.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+namespace fst_log_file
+{
+
+	//单线程写、任意线程读的计数器
+	class stat_counter : boost::noncopyable
+	{
+	public:
+		stat_counter() { value_.store(0, boost::memory_order_relaxed); }
+
+		void add(boost::uint64_t n)
+		{
+			value_.store(value_.load(boost::memory_order_relaxed) + n, boost::memory_order_relaxed);
+		}
+		void set_max(boost::uint64_t n)
+		{
+			if (n > value_.load(boost::memory_order_relaxed))
+				value_.store(n, boost::memory_order_relaxed);
+		}
+		void set(boost::uint64_t n) { value_.store(n, boost::memory_order_relaxed); }
+		boost::uint64_t get() const { return value_.load(boost::memory_order_relaxed); }
+
+	private:
+		boost::atomic<boost::uint64_t> value_;
+	};
+
+	//第i个桶统计耗时在[2^i , 2^(i+1))纳秒之间的次数,最后一个桶包括更长的
+	#define  LOG_HISTOGRAM_BUCKETS	(32)
+
+	struct histogram_snapshot
+	{
+		boost::uint64_t buckets[LOG_HISTOGRAM_BUCKETS] ;
+		boost::uint64_t count ;
+		boost::uint64_t sum_ns ;
+		boost::uint64_t max_ns ;
+
+		void clear();
+		void merge(const histogram_snapshot& other);
+		//返回第p(0~1)分位所在桶的上界,纳秒
+		boost::uint64_t percentile(double p) const;
+	};
+
+	class latency_histogram : boost::noncopyable
+	{
+	public:
+		void record(boost::uint64_t ns)
+		{
+			int bucket = 0 ;
+			for (boost::uint64_t v = ns >> 1; v != 0 && bucket < LOG_HISTOGRAM_BUCKETS - 1; v >>= 1)
+				++bucket ;
+			buckets_[bucket].add(1);
+			count_.add(1);
+			sum_ns_.add(ns);
+			max_ns_.set_max(ns);
+		}
+
+		void snapshot(histogram_snapshot* out) const;
+
+	private:
+		stat_counter buckets_[LOG_HISTOGRAM_BUCKETS];
+		stat_counter count_;
+		stat_counter sum_ns_;
+		stat_counter max_ns_;
+	};
+
+	//单调时钟,纳秒,只用于计算耗时
+	boost::uint64_t stats_now_ns();
+
+	struct log_file_stats
+	{
+		boost::uint64_t bytes_written ;
+		boost::uint64_t rolls ;
+		boost::uint64_t precreated_rolls ;	//换上后台预先创建的文件的滚动次数
+		histogram_snapshot write_latency ;	//每次写文件
+		histogram_snapshot flush_latency ;
+		histogram_snapshot roll_latency ;	//rollFile,包括关闭旧文件和打开新文件
+		boost::uint64_t syncs ;				//同步线程的fdatasync/sync_file_range次数
+		histogram_snapshot sync_latency ;
+		boost::uint64_t compressed_files ;	//压缩完成的滚动文件
+		boost::uint64_t compress_bytes_in ;
+		boost::uint64_t compress_bytes_out ;
+	};
+
+}
+
+#endif
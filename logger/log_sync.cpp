@@ -0,0 +1,224 @@
+#include "stdafx.h"
+#include "log_sync.h"
+#include "threadctrl/threadctrl.h"
+#include "threadctrl/threadctrl_ext.h"
+#ifdef WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <boost/bind.hpp>
+
+namespace fst_log_file
+{
+
+static void close_fd(int fd)
+{
+#ifdef WIN32
+	::_close(fd);
+#else
+	::close(fd);
+#endif
+}
+
+log_syncer::log_syncer(const file_options& options)
+: options_(options),
+thread_(NULL),
+running_(false),
+requested_(false),
+fd_(-1),
+generation_(0),
+synced_generation_(0),
+synced_(0),
+behind_start_(0),
+behind_len_(0)
+{
+	written_.store(0);
+	THREADCTL_ALLOC_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+	THREADCTL_ALLOC_COND(cond_);
+}
+
+log_syncer::~log_syncer()
+{
+	stop();
+	if (fd_ >= 0)
+		close_fd(fd_);
+	for (size_t i = 0; i < retired_fds_.size(); ++i)
+		close_fd(retired_fds_[i]);
+	THREADCTL_FREE_COND(cond_);
+	THREADCTL_FREE_LOCK(mutex_ , THREADCTL_LOCKTYPE_READWRITE);
+}
+
+void log_syncer::start()
+{
+	running_ = true ;
+	thread_ = new boost::thread(boost::bind(&log_syncer::threadFunc , this));
+}
+
+void log_syncer::stop()
+{
+	if (thread_ == NULL)
+		return ;
+	{
+		lock_guard lock(mutex_);
+		running_ = false ;
+		THREADCTL_COND_BROADCAST(cond_);
+	}
+	thread_->join();
+	delete thread_ ;
+	thread_ = NULL ;
+}
+
+void log_syncer::set_file(int fd)
+{
+	lock_guard lock(mutex_);
+	if (fd_ >= 0)
+		retired_fds_.push_back(fd_);
+	fd_ = fd ;
+	++generation_ ;
+	written_.store(0 , boost::memory_order_relaxed);
+	THREADCTL_COND_BROADCAST(cond_);
+}
+
+void log_syncer::written(size_t bytes)
+{
+	size_t prev = written_.load(boost::memory_order_relaxed);
+	written_.store(bytes , boost::memory_order_relaxed);
+	//跨过一个回写块时叫醒同步线程,不必等到sync_interval
+	if (options_.durability == DURABILITY_WRITE_BEHIND &&
+		bytes / options_.write_behind_size != prev / options_.write_behind_size)
+	{
+		lock_guard lock(mutex_);
+		THREADCTL_COND_BROADCAST(cond_);
+	}
+}
+
+void log_syncer::request_sync()
+{
+	lock_guard lock(mutex_);
+	requested_ = true ;
+	THREADCTL_COND_BROADCAST(cond_);
+}
+
+void log_syncer::sync_data(int fd)
+{
+	boost::uint64_t start = stats_now_ns();
+#if defined(WIN32)
+	::_commit(fd);
+#elif defined(__linux__)
+	::fdatasync(fd);
+#else
+	::fsync(fd);
+#endif
+	sync_latency_.record(stats_now_ns() - start);
+	syncs_.add(1);
+}
+
+//发起新写满的块的回写,并等上一轮发起的回写完成,使脏页不会无限堆积
+void log_syncer::write_behind(int fd, size_t written)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+	size_t end = written - written % options_.write_behind_size ;
+	if (end <= synced_)
+		return ;
+	boost::uint64_t start = stats_now_ns();
+	if (behind_len_ > 0)
+		::sync_file_range(fd, behind_start_, behind_len_,
+			SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+	::sync_file_range(fd, synced_, end - synced_, SYNC_FILE_RANGE_WRITE);
+	sync_latency_.record(stats_now_ns() - start);
+	syncs_.add(1);
+	behind_start_ = synced_ ;
+	behind_len_ = end - synced_ ;
+	synced_ = end ;
+#else
+	//没有sync_file_range时退化为按间隔fdatasync
+	if (written != synced_)
+	{
+		sync_data(fd);
+		synced_ = written ;
+	}
+#endif
+}
+
+void log_syncer::threadFunc()
+{
+	for (;;)
+	{
+		int fd ;
+		unsigned generation ;
+		size_t written ;
+		bool requested ;
+		bool running ;
+		std::vector<int> retired ;
+		{
+			lock_guard lock(mutex_);
+			if (running_ && !requested_ && retired_fds_.empty())
+			{
+				timeval wait_time;
+				wait_time.tv_sec = options_.sync_interval_ms / 1000 ;
+				wait_time.tv_usec = (options_.sync_interval_ms % 1000) * 1000 ;
+				THREADCTL_COND_WAIT_TIMED(cond_ , mutex_ , &wait_time);
+			}
+			fd = fd_ ;
+			generation = generation_ ;
+			written = written_.load(boost::memory_order_relaxed);
+			requested = requested_ ;
+			requested_ = false ;
+			running = running_ ;
+			retired.swap(retired_fds_);
+		}
+
+		//滚动掉的文件不会再写,落盘后关闭
+		for (size_t i = 0; i < retired.size(); ++i)
+		{
+			sync_data(retired[i]);
+			close_fd(retired[i]);
+		}
+		if (fd < 0)
+		{
+			if (!running)
+				break ;
+			continue ;
+		}
+
+		if (generation != synced_generation_)
+		{
+			synced_generation_ = generation ;
+			synced_ = 0 ;
+			behind_start_ = behind_len_ = 0 ;
+		}
+
+		if (!running)
+		{
+			sync_data(fd);
+			break ;
+		}
+
+		switch (options_.durability)
+		{
+		case DURABILITY_PERIODIC:
+			if (written != synced_)
+			{
+				sync_data(fd);
+				synced_ = written ;
+			}
+			break;
+		case DURABILITY_WRITE_BEHIND:
+			write_behind(fd , written);
+			break;
+		case DURABILITY_ON_ERROR:
+			if (requested)
+			{
+				sync_data(fd);
+				synced_ = written ;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+}
@@ -0,0 +1,74 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_sync.h
+file path:	logfile
+file base:	log_sync
+file ext:	h
+author:
+
+purpose:	日志文件的落盘线程。log_file把当前文件描述符的副本和已写入的
+			长度交给它,fdatasync/sync_file_range都在这个线程里执行,
+			写文件的线程不会因为等设备而阻塞。
+*********************************************************************/
+#ifndef __LOG_SYNC_INCLUDE__
+#define __LOG_SYNC_INCLUDE__
+
+#include <vector>
+#include <boost/utility.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include "file_engine.h"
+#include "log_stats.h"
+
+namespace fst_log_file
+{
+
+	class log_syncer : boost::noncopyable
+	{
+	public:
+		explicit log_syncer(const file_options& options);
+		~log_syncer();
+
+		void start();
+		//同步并关闭所有文件后退出线程
+		void stop();
+
+		//换成新文件,fd由log_syncer接管;旧文件在同步线程里落盘后关闭
+		void set_file(int fd);
+		//当前文件已经写入的字节数,只由写文件的线程调用
+		void written(size_t bytes);
+		//DURABILITY_ON_ERROR下写出WARN/ERR之后调用
+		void request_sync();
+
+		boost::uint64_t syncs() const { return syncs_.get(); }
+		void sync_latency(histogram_snapshot* out) const { sync_latency_.snapshot(out); }
+
+	private:
+		void threadFunc();
+		void sync_data(int fd);
+		void write_behind(int fd, size_t written);
+
+		const file_options options_;
+		void* mutex_ ;
+		void* cond_ ;
+		boost::thread* thread_ ;
+		bool running_ ;
+		bool requested_ ;
+		int fd_ ;
+		unsigned generation_ ;		//每换一次文件加一,fd的数值可能被复用
+		std::vector<int> retired_fds_ ;
+		boost::atomic<size_t> written_ ;
+
+		//以下只由同步线程访问
+		unsigned synced_generation_ ;	//synced_所属的文件
+		size_t synced_ ;			//已经同步或发起回写的位置
+		size_t behind_start_ ;		//上一次sync_file_range发起的范围,下一轮等它完成
+		size_t behind_len_ ;
+
+		stat_counter syncs_;
+		latency_histogram sync_latency_;
+	};
+
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include "stdafx.h"
+#include <string.h>
+#include "log_time.h"
+#include "log_file.h"
+
+namespace fst_log_file
+{
+
+static const char kDigitPairs[] =
+	"00010203040506070809"
+	"10111213141516171819"
+	"20212223242526272829"
+	"30313233343536373839"
+	"40414243444546474849"
+	"50515253545556575859"
+	"60616263646566676869"
+	"70717273747576777879"
+	"80818283848586878889"
+	"90919293949596979899";
+
+char* write_fixed_digits(char* dst , unsigned long value , int width)
+{
+	char* end = dst + width ;
+	char* p = end ;
+	while (p - dst >= 2)
+	{
+		p -= 2 ;
+		memcpy(p , kDigitPairs + (value % 100) * 2 , 2);
+		value /= 100 ;
+	}
+	if (p != dst)
+		*--p = static_cast<char>('0' + value % 10);
+	return end ;
+}
+
+//当前线程上一次格式化的秒,以及对应的"YYYY-MM-DD HH:MM:SS."
+struct second_cache
+{
+	time_t sec ;
+	char text[20] ;
+};
+static LOG_THREAD_LOCAL second_cache tls_second_cache = { -1 , { 0 } };
+
+void log_clock_now(log_timestamp* ts , TimePrecision precision)
+{
+#ifdef WIN32
+	//FILETIME是1601年起的100纳秒数
+	const unsigned __int64 kEpochBias = 116444736000000000ui64 ;
+	union {
+		FILETIME ft ;
+		unsigned __int64 u64 ;
+	} now ;
+#if defined(_WIN32_WINNT) && (_WIN32_WINNT >= 0x0602)
+	if (precision != TIME_PRECISION_MS)
+		::GetSystemTimePreciseAsFileTime(&now.ft);
+	else
+#endif
+		::GetSystemTimeAsFileTime(&now.ft);
+	now.u64 -= kEpochBias ;
+	ts->sec = static_cast<time_t>(now.u64 / 10000000);
+	ts->nsec = static_cast<long>(now.u64 % 10000000) * 100 ;
+#else
+	struct timespec now ;
+#ifdef CLOCK_REALTIME_COARSE
+	::clock_gettime(precision == TIME_PRECISION_MS ? CLOCK_REALTIME_COARSE : CLOCK_REALTIME , &now);
+#else
+	::clock_gettime(CLOCK_REALTIME , &now);
+#endif
+	ts->sec = now.tv_sec ;
+	ts->nsec = now.tv_nsec ;
+#endif
+}
+
+int format_log_time(char* dst , const log_timestamp& ts , TimePrecision precision)
+{
+	second_cache& cache = tls_second_cache ;
+	if (cache.sec != ts.sec)
+	{
+		struct tm tm ;
+#ifdef WIN32
+		::localtime_s(&tm , &ts.sec);
+#else
+		::localtime_r(&ts.sec , &tm);
+#endif
+		char* p = cache.text ;
+		p = write_fixed_digits(p , tm.tm_year + 1900 , 4);
+		*p++ = '-';
+		p = write_fixed_digits(p , tm.tm_mon + 1 , 2);
+		*p++ = '-';
+		p = write_fixed_digits(p , tm.tm_mday , 2);
+		*p++ = ' ';
+		p = write_fixed_digits(p , tm.tm_hour , 2);
+		*p++ = ':';
+		p = write_fixed_digits(p , tm.tm_min , 2);
+		*p++ = ':';
+		p = write_fixed_digits(p , tm.tm_sec , 2);
+		*p++ = '.';
+		cache.sec = ts.sec ;
+	}
+
+	memcpy(dst , cache.text , sizeof cache.text);
+
+	unsigned long frac = static_cast<unsigned long>(ts.nsec);
+	int digits = log_time_digits(precision);
+	if (precision == TIME_PRECISION_MS)
+		frac /= 1000000 ;
+	else if (precision == TIME_PRECISION_US)
+		frac /= 1000 ;
+	write_fixed_digits(dst + sizeof cache.text , frac , digits);
+	return static_cast<int>(sizeof cache.text) + digits ;
+}
+
+}
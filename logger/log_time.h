@@ -0,0 +1,55 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_time.h
+file path:	logfile
+file base:	log_time
+file ext:	h
+author:
+
+purpose:	日志时间戳的获取与格式化。每个线程缓存当前秒的
+			"YYYY-MM-DD HH:MM:SS"文本,只有跨秒时才重新调用localtime,
+			平时只需要补上小数部分。
+*********************************************************************/
+#ifndef __LOG_TIME_INCLUDE__
+#define __LOG_TIME_INCLUDE__
+
+#include <time.h>
+
+namespace fst_log_file
+{
+
+	//时间戳小数部分的精度
+	enum TimePrecision
+	{
+		TIME_PRECISION_MS = 0,	//毫秒,3位
+		TIME_PRECISION_US,		//微秒,6位
+		TIME_PRECISION_NS,		//纳秒,9位
+	};
+
+	struct log_timestamp
+	{
+		time_t sec ;
+		long nsec ;
+	};
+
+	//"YYYY-MM-DD HH:MM:SS." 加上最长9位小数
+	#define  LOG_TIME_MAX_LEN	(29)
+
+	//读取当前时间,毫秒精度使用开销最小的粗粒度时钟
+	void log_clock_now(log_timestamp* ts , TimePrecision precision);
+
+	//按本地时间格式化到dst,返回写入的字节数(不以'\0'结尾)
+	int format_log_time(char* dst , const log_timestamp& ts , TimePrecision precision);
+
+	//小数部分的位数
+	inline int log_time_digits(TimePrecision precision)
+	{
+		return precision == TIME_PRECISION_NS ? 9 : (precision == TIME_PRECISION_US ? 6 : 3);
+	}
+
+	//写入固定宽度的十进制数,不足的位补0,返回写入后的位置
+	char* write_fixed_digits(char* dst , unsigned long value , int width);
+
+}
+
+#endif
@@ -0,0 +1,156 @@
+#include "stdafx.h"
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "log_watch.h"
+#ifdef __linux__
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#endif
+#include <boost/bind.hpp>
+
+namespace fst_log_file
+{
+
+//检查running_的间隔,stop()最多等这么久
+static const int kTickMs = 200 ;
+//编辑器保存时会连续产生几个事件,安静这么久之后再读文件
+static const int kSettleMs = 100 ;
+
+config_watcher::config_watcher(const std::string& filename , int interval_ms , const boost::function<void()>& on_change)
+: filename_(filename),
+interval_ms_(interval_ms < kTickMs ? kTickMs : interval_ms),
+on_change_(on_change),
+inotify_fd_(-1),
+thread_(NULL)
+{
+	running_.store(false);
+	memset(&last_ , 0 , sizeof last_);
+
+	std::string::size_type slash = filename.find_last_of("/\\");
+	if (slash == std::string::npos)
+	{
+		dir_ = "." ;
+		name_ = filename ;
+	}
+	else
+	{
+		dir_ = slash == 0 ? std::string("/") : filename.substr(0 , slash);
+		name_ = filename.substr(slash + 1);
+	}
+	//记下当前的状态,之后的比较才有基准
+	file_changed();
+}
+
+config_watcher::~config_watcher()
+{
+	stop();
+#ifdef __linux__
+	if (inotify_fd_ >= 0)
+		::close(inotify_fd_);
+#endif
+}
+
+void config_watcher::start()
+{
+#ifdef __linux__
+	inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (inotify_fd_ >= 0 &&
+		::inotify_add_watch(inotify_fd_ , dir_.c_str() , IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0)
+	{
+		::close(inotify_fd_);
+		inotify_fd_ = -1 ;
+	}
+#endif
+	running_.store(true);
+	thread_ = new boost::thread(boost::bind(&config_watcher::threadFunc , this));
+}
+
+void config_watcher::stop()
+{
+	if (thread_ == NULL)
+		return ;
+	running_.store(false);
+	thread_->join();
+	delete thread_ ;
+	thread_ = NULL ;
+}
+
+void config_watcher::threadFunc()
+{
+	int elapsed = 0 ;
+	while (running_.load())
+	{
+		bool changed = wait_event(kTickMs);
+		elapsed += kTickMs ;
+		if (changed)
+		{
+			while (running_.load() && wait_event(kSettleMs))
+				;
+			//更新基准,下面的比较不再重复触发
+			file_changed();
+		}
+		else if (elapsed >= interval_ms_)
+			changed = file_changed();
+		else
+			continue ;
+
+		elapsed = 0 ;
+		if (changed && running_.load())
+			on_change_();
+	}
+}
+
+//等到目录里有这个文件的事件时返回true,超时或只有其他文件的事件时返回false
+bool config_watcher::wait_event(int timeout_ms)
+{
+#ifdef __linux__
+	if (inotify_fd_ >= 0)
+	{
+		struct pollfd pfd ;
+		pfd.fd = inotify_fd_ ;
+		pfd.events = POLLIN ;
+		pfd.revents = 0 ;
+		if (::poll(&pfd , 1 , timeout_ms) <= 0)
+			return false ;
+
+		bool matched = false ;
+		char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+		for (;;)
+		{
+			ssize_t len = ::read(inotify_fd_ , buf , sizeof buf);
+			if (len <= 0)
+				break ;
+			for (const char* p = buf; p < buf + len; )
+			{
+				const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+				if ((event->mask & IN_Q_OVERFLOW) || (event->len > 0 && name_ == event->name))
+					matched = true ;
+				p += sizeof(struct inotify_event) + event->len ;
+			}
+		}
+		return matched ;
+	}
+#endif
+	boost::this_thread::sleep(boost::posix_time::milliseconds(timeout_ms));
+	return false ;
+}
+
+bool config_watcher::file_changed()
+{
+	struct stat st ;
+	//改名替换的瞬间文件可能不存在,下次再看
+	if (::stat(filename_.c_str() , &st) != 0)
+		return false ;
+
+	file_state now ;
+	now.mtime = st.st_mtime ;
+	now.size = st.st_size ;
+	now.inode = st.st_ino ;
+	bool changed = now.mtime != last_.mtime || now.size != last_.size || now.inode != last_.inode ;
+	last_ = now ;
+	return changed ;
+}
+
+}
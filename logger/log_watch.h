@@ -0,0 +1,61 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	log_watch.h
+file path:	logfile
+file base:	log_watch
+file ext:	h
+author:
+
+purpose:	监视配置文件,变化后在监视线程里回调。linux下用inotify监视
+			文件所在的目录(编辑器常常先写临时文件再改名),同时按间隔
+			比较文件的修改时间、大小和inode,inotify不可用时只靠比较。
+*********************************************************************/
+#ifndef __LOG_WATCH_INCLUDE__
+#define __LOG_WATCH_INCLUDE__
+
+#include <time.h>
+#include <string>
+#include <boost/utility.hpp>
+#include <boost/atomic.hpp>
+#include <boost/thread.hpp>
+#include <boost/function.hpp>
+
+namespace fst_log_file
+{
+
+	class config_watcher : boost::noncopyable
+	{
+	public:
+		config_watcher(const std::string& filename , int interval_ms , const boost::function<void()>& on_change);
+		~config_watcher();
+
+		void start();
+		//最多等一个检查周期
+		void stop();
+
+	private:
+		struct file_state
+		{
+			time_t mtime ;
+			long long size ;
+			unsigned long long inode ;
+		};
+
+		void threadFunc();
+		bool wait_event(int timeout_ms);
+		bool file_changed();
+
+		const std::string filename_ ;
+		const int interval_ms_ ;
+		boost::function<void()> on_change_ ;
+		std::string dir_ ;		//inotify监视的目录
+		std::string name_ ;		//目录下的文件名
+		int inotify_fd_ ;
+		file_state last_ ;
+		boost::atomic<bool> running_ ;
+		boost::thread* thread_ ;
+	};
+
+}
+
+#endif
@@ -0,0 +1,163 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	mpsc_queue.h
+file path:	logfile
+file base:	mpsc_queue
+file ext:	h
+author:
+
+purpose:	有界多生产者/单消费者无锁队列(Vyukov的数组加序号算法)。
+			每个槽位存放一条完整的日志记录,生产者在无竞争时只需要
+			一次CAS,消费者只有后台日志线程一个。
+*********************************************************************/
+#ifndef __MPSC_QUEUE_INCLUDE__
+#define __MPSC_QUEUE_INCLUDE__
+
+#include <string.h>
+#include <stddef.h>
+#include <new>
+#include <boost/utility.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+#include "spsc_ring.h"
+
+namespace fst_log_file
+{
+
+	class mpsc_queue : boost::noncopyable
+	{
+	public:
+		//slots向上取整为2的幂,slot_size为一条记录的最大字节数
+		mpsc_queue(size_t slots , size_t slot_size)
+			: capacity_(round_up_pow2(slots < 2 ? 2 : slots)),
+			mask_(capacity_ - 1),
+			slot_size_(slot_size),
+			stride_(round_up(sizeof(cell) + slot_size, LOG_CACHE_LINE_SIZE)),
+			storage_(new char[capacity_ * stride_ + LOG_CACHE_LINE_SIZE]),
+			dequeue_cache_(0)
+		{
+			//槽位按cache line对齐,相邻槽位不会互相干扰
+			size_t misalign = reinterpret_cast<size_t>(storage_) % LOG_CACHE_LINE_SIZE;
+			cells_ = storage_ + (misalign ? LOG_CACHE_LINE_SIZE - misalign : 0);
+			for (size_t i = 0; i < capacity_; ++i)
+				new (cell_at(i)) cell(i);
+
+			enqueue_pos_.store(0, boost::memory_order_relaxed);
+			dequeue_pos_.store(0, boost::memory_order_relaxed);
+		}
+
+		~mpsc_queue()
+		{
+			for (size_t i = 0; i < capacity_; ++i)
+				cell_at(i)->~cell();
+			delete [] storage_;
+		}
+
+		//生产者调用,队列满或记录超长时返回false
+		bool push(const char* logline, size_t len, unsigned tag = 0)
+		{
+			if (len > slot_size_)
+				return false;
+
+			cell* c;
+			size_t pos = enqueue_pos_.load(boost::memory_order_relaxed);
+			for (;;)
+			{
+				c = cell_at(pos);
+				size_t seq = c->sequence.load(boost::memory_order_acquire);
+				ptrdiff_t dif = static_cast<ptrdiff_t>(seq - pos);
+				if (dif == 0)
+				{
+					if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, boost::memory_order_relaxed))
+						break;
+				}
+				else if (dif < 0)
+					return false;
+				else
+					pos = enqueue_pos_.load(boost::memory_order_relaxed);
+			}
+
+			c->len = static_cast<boost::uint32_t>(len);
+			c->tag = tag;
+			memcpy(c->data(), logline, len);
+			c->sequence.store(pos + 1, boost::memory_order_release);
+			return true;
+		}
+
+		//消费者调用,返回队首记录的长度,队列为空(或队首槽位还没写完)时返回-1
+		int front_length(unsigned* tag = NULL)
+		{
+			cell* c = cell_at(dequeue_cache_);
+			if (c->sequence.load(boost::memory_order_acquire) != dequeue_cache_ + 1)
+				return -1;
+			if (tag)
+				*tag = c->tag;
+			return static_cast<int>(c->len);
+		}
+
+		//消费者调用,把队首记录拷贝到dst并出队
+		void pop(char* dst, size_t len)
+		{
+			cell* c = cell_at(dequeue_cache_);
+			memcpy(dst, c->data(), len);
+			c->sequence.store(dequeue_cache_ + capacity_, boost::memory_order_release);
+			++dequeue_cache_;
+			dequeue_pos_.store(dequeue_cache_, boost::memory_order_relaxed);
+		}
+
+		//已占用的槽位数,只是一个近似值
+		size_t size() const
+		{
+			size_t enq = enqueue_pos_.load(boost::memory_order_relaxed);
+			size_t deq = dequeue_pos_.load(boost::memory_order_relaxed);
+			return enq > deq ? enq - deq : 0;
+		}
+		size_t capacity() const { return capacity_; }
+		bool empty() const { return size() == 0; }
+
+	private:
+		struct cell
+		{
+			explicit cell(size_t seq) : len(0), tag(0) { sequence.store(seq, boost::memory_order_relaxed); }
+			char* data() { return reinterpret_cast<char*>(this + 1); }
+
+			boost::atomic<size_t> sequence;
+			boost::uint32_t len;
+			unsigned tag;
+		};
+
+		static size_t round_up_pow2(size_t n)
+		{
+			size_t r = 1;
+			while (r < n)
+				r <<= 1;
+			return r;
+		}
+		static size_t round_up(size_t n, size_t align) { return (n + align - 1) / align * align; }
+
+		cell* cell_at(size_t pos) const
+		{
+			return reinterpret_cast<cell*>(cells_ + (pos & mask_) * stride_);
+		}
+
+		const size_t capacity_;
+		const size_t mask_;
+		const size_t slot_size_;
+		const size_t stride_;
+		char* const storage_;
+		char* cells_;
+
+		//生产者共享的cache line
+		char pad0_[LOG_CACHE_LINE_SIZE];
+		boost::atomic<size_t> enqueue_pos_;
+
+		//消费者独占的cache line
+		char pad1_[LOG_CACHE_LINE_SIZE];
+		size_t dequeue_cache_;
+		boost::atomic<size_t> dequeue_pos_;
+		char pad2_[LOG_CACHE_LINE_SIZE];
+	};
+
+}
+
+#endif
@@ -0,0 +1,140 @@
+/********************************************************************
+created:	2026/10/17
+filename: 	spsc_ring.h
+file path:	logfile
+file base:	spsc_ring
+file ext:	h
+author:
+
+purpose:	单生产者/单消费者无锁环形缓冲,每个生产者线程独占一个,
+			后台日志线程负责消费。记录格式为[uint32 长度][日志内容],
+			一条记录要么完整可见,要么不可见。
+*********************************************************************/
+#ifndef __SPSC_RING_INCLUDE__
+#define __SPSC_RING_INCLUDE__
+
+#include <string.h>
+#include <boost/utility.hpp>
+#include <boost/atomic.hpp>
+#include <boost/cstdint.hpp>
+
+#define  LOG_CACHE_LINE_SIZE	(64)
+
+namespace fst_log_file
+{
+
+	class spsc_ring : boost::noncopyable
+	{
+	public:
+		//capacity向上取整为2的幂
+		explicit spsc_ring(size_t capacity)
+			: capacity_(round_up_pow2(capacity < 64 ? 64 : capacity)),
+			mask_(capacity_ - 1),
+			data_(new char[capacity_]),
+			cached_tail_(0),
+			cached_head_(0)
+		{
+			head_.store(0, boost::memory_order_relaxed);
+			tail_.store(0, boost::memory_order_relaxed);
+		}
+
+		~spsc_ring() { delete [] data_; }
+
+		//生产者调用,空间不足时返回false,不写入任何内容。
+		//记录头的低24位是长度,高8位是调用方的tag
+		bool push(const char* logline, size_t len, unsigned tag = 0)
+		{
+			const size_t need = sizeof(boost::uint32_t) + len;
+			const size_t tail = tail_.load(boost::memory_order_relaxed);
+			if (tail + need - cached_head_ > capacity_)
+			{
+				cached_head_ = head_.load(boost::memory_order_acquire);
+				if (tail + need - cached_head_ > capacity_)
+					return false;
+			}
+
+			boost::uint32_t header = static_cast<boost::uint32_t>(len) | (static_cast<boost::uint32_t>(tag) << 24);
+			copy_in(tail, reinterpret_cast<const char*>(&header), sizeof header);
+			copy_in(tail + sizeof header, logline, len);
+			tail_.store(tail + need, boost::memory_order_release);
+			return true;
+		}
+
+		//消费者调用,返回队首记录的长度,队列为空时返回-1
+		int front_length(unsigned* tag = NULL)
+		{
+			const size_t head = head_.load(boost::memory_order_relaxed);
+			if (head == cached_tail_)
+			{
+				cached_tail_ = tail_.load(boost::memory_order_acquire);
+				if (head == cached_tail_)
+					return -1;
+			}
+
+			boost::uint32_t header;
+			copy_out(head, reinterpret_cast<char*>(&header), sizeof header);
+			if (tag)
+				*tag = header >> 24;
+			return static_cast<int>(header & 0xffffff);
+		}
+
+		//消费者调用,把队首记录拷贝到dst并出队,dst至少有front_length()个字节
+		void pop(char* dst, size_t len)
+		{
+			const size_t head = head_.load(boost::memory_order_relaxed);
+			copy_out(head + sizeof(boost::uint32_t), dst, len);
+			head_.store(head + sizeof(boost::uint32_t) + len, boost::memory_order_release);
+		}
+
+		//已使用的字节数,两端都可以调用,结果只是一个近似值
+		size_t size() const
+		{
+			return tail_.load(boost::memory_order_acquire) - head_.load(boost::memory_order_acquire);
+		}
+		size_t capacity() const { return capacity_; }
+		bool empty() const { return size() == 0; }
+
+	private:
+		static size_t round_up_pow2(size_t n)
+		{
+			size_t r = 1;
+			while (r < n)
+				r <<= 1;
+			return r;
+		}
+
+		void copy_in(size_t pos, const char* src, size_t len)
+		{
+			const size_t off = pos & mask_;
+			const size_t first = (len < capacity_ - off) ? len : capacity_ - off;
+			memcpy(data_ + off, src, first);
+			memcpy(data_, src + first, len - first);
+		}
+
+		void copy_out(size_t pos, char* dst, size_t len) const
+		{
+			const size_t off = pos & mask_;
+			const size_t first = (len < capacity_ - off) ? len : capacity_ - off;
+			memcpy(dst, data_ + off, first);
+			memcpy(dst + first, data_, len - first);
+		}
+
+		const size_t capacity_;
+		const size_t mask_;
+		char* const data_;
+
+		//消费者独占的cache line
+		char pad0_[LOG_CACHE_LINE_SIZE];
+		boost::atomic<size_t> head_;
+		size_t cached_tail_;
+
+		//生产者独占的cache line
+		char pad1_[LOG_CACHE_LINE_SIZE];
+		boost::atomic<size_t> tail_;
+		size_t cached_head_;
+		char pad2_[LOG_CACHE_LINE_SIZE];
+	};
+
+}
+
+#endif
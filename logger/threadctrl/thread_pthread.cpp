@@ -1,6 +1,8 @@
 #include "stdafx.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include "threadctrl.h"
 
 
@@ -13,14 +15,12 @@
 #include <windows.h>
 #undef WIN32_LEAN_AND_MEAN
 #include <sys/locking.h>
+#pragma comment(lib,"pthreadVC2.lib")
 #else
 #include <pthread.h>
+#include <sys/time.h>
 #endif
 
-
-
-#pragma comment(lib,"pthreadVC2.lib")
-
 static pthread_mutexattr_t attr_recursive;
 
 static void *
@@ -18,6 +18,8 @@
 #include <sys/locking.h>
 #endif
 
+#ifdef _WIN32
+
 #define SPIN_COUNT 2000
 
 
@@ -329,3 +331,5 @@ threadctl_win32_condvar_wait(void *cond_, void *lock_, const struct timeval *tv)
 
 	 return 0;
  }
+
+#endif /* _WIN32 */
@@ -42,4 +42,13 @@ int threadctl_set_condition_callbacks( const struct threadctl_condition_callback
 void threadctl_set_id_callback(  unsigned long (*id_fn)(void))
 {
 threadctl_id_fn_ = id_fn ; 
-}
\ No newline at end of file
+}
+
+int threadctl_use_default_threads(void)
+{
+#ifdef WIN32
+	return threadctl_use_windows_threads();
+#else
+	return threadctl_use_pthreads();
+#endif
+}
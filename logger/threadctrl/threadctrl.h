@@ -5,9 +5,9 @@
 extern "C" {
 #endif
 
-/*:ݹ*/
+/*锁类型:递归锁*/
 #define THREADCTL_LOCKTYPE_RECURSIVE 1
-/*:д*/
+/*锁类型:读写锁*/
 #define THREADCTL_LOCKTYPE_READWRITE 2
 
 /*locktype*/
@@ -84,6 +84,9 @@ void	threadctl_set_id_callback(  unsigned long (*id_fn)(void)) ;
 
 int	threadctl_use_windows_threads(void) ; 
 int	threadctl_use_pthreads(void);
+/** Install the native backend for this platform: windows threads on WIN32,
+ * pthreads everywhere else. */
+int	threadctl_use_default_threads(void);
 
 
 
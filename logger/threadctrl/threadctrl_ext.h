@@ -24,6 +24,26 @@ private:
 };
 
 
+//接管调用方已经持有的锁,析构时释放
+class adopt_lock_guard  
+{  
+public:  
+	explicit adopt_lock_guard(void* lock)  
+		: m_(lock)  
+	{}  
+
+	~adopt_lock_guard()  
+	{  
+		THREADCTL_UNLOCK(m_,THREADCTL_WRITE);
+	}  
+
+private:  
+	adopt_lock_guard(const adopt_lock_guard&);  
+	adopt_lock_guard& operator=(const adopt_lock_guard&);  
+	void* m_;  
+};
+
+
 class countdown_latch
 {
 public:
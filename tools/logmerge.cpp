@@ -0,0 +1,479 @@
+//把多个日志文件(分片的basename.s0、basename.s1...或者各进程、各线程的文件)按时间戳和序号合并成一条时间线,
+//输出到标准输出:
+//	logmerge applog/app.s*.log | less
+//	logmerge -s "2026-10-17 12:00:00" -e "2026-10-17 12:05:00" applog/*.log > incident.log
+//文件用mmap映射,每个文件预读-w条记录,从各文件预读的记录中按(时间戳,序号)取最小的输出,
+//分片内因为线程交错造成的少量乱序在预读窗口内就能纠正。不以时间戳开头的行属于上一条记录。
+//只读文本日志,.lz文件先用lzcat解压
+#include "stdafx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <deque>
+#include <queue>
+#ifdef WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace
+{
+	typedef long long int64 ;
+	typedef unsigned long long uint64 ;
+
+	const int64 kNsPerSec = 1000000000LL ;
+
+	//只读映射整个文件
+	class mapped_file
+	{
+	public:
+		mapped_file() : data_(NULL) , size_(0)
+#ifdef WIN32
+			, file_(INVALID_HANDLE_VALUE) , mapping_(NULL)
+#endif
+		{}
+
+		~mapped_file() { close(); }
+
+		bool open(const char* path)
+		{
+#ifdef WIN32
+			file_ = ::CreateFileA(path , GENERIC_READ , FILE_SHARE_READ | FILE_SHARE_WRITE , NULL ,
+				OPEN_EXISTING , FILE_FLAG_SEQUENTIAL_SCAN , NULL);
+			if (file_ == INVALID_HANDLE_VALUE)
+				return false ;
+			LARGE_INTEGER size ;
+			if (!::GetFileSizeEx(file_ , &size))
+				return false ;
+			size_ = static_cast<size_t>(size.QuadPart);
+			if (size_ == 0)
+				return true ;
+			mapping_ = ::CreateFileMappingA(file_ , NULL , PAGE_READONLY , 0 , 0 , NULL);
+			if (mapping_ == NULL)
+				return false ;
+			data_ = static_cast<const char*>(::MapViewOfFile(mapping_ , FILE_MAP_READ , 0 , 0 , 0));
+			return data_ != NULL ;
+#else
+			int fd = ::open(path , O_RDONLY);
+			if (fd < 0)
+				return false ;
+			struct stat st ;
+			if (::fstat(fd , &st) != 0)
+			{
+				::close(fd);
+				return false ;
+			}
+			size_ = static_cast<size_t>(st.st_size);
+			if (size_ == 0)
+			{
+				::close(fd);
+				return true ;
+			}
+			void* p = ::mmap(NULL , size_ , PROT_READ , MAP_PRIVATE , fd , 0);
+			::close(fd);
+			if (p == MAP_FAILED)
+				return false ;
+			::madvise(p , size_ , MADV_SEQUENTIAL);
+			data_ = static_cast<const char*>(p);
+			return true ;
+#endif
+		}
+
+		void close()
+		{
+#ifdef WIN32
+			if (data_)
+				::UnmapViewOfFile(data_);
+			if (mapping_)
+				::CloseHandle(mapping_);
+			if (file_ != INVALID_HANDLE_VALUE)
+				::CloseHandle(file_);
+			mapping_ = NULL ;
+			file_ = INVALID_HANDLE_VALUE ;
+#else
+			if (data_)
+				::munmap(const_cast<char*>(data_) , size_);
+#endif
+			data_ = NULL ;
+			size_ = 0 ;
+		}
+
+		const char* data() const { return data_; }
+		size_t size() const { return size_; }
+
+	private:
+		mapped_file(const mapped_file&);
+		mapped_file& operator=(const mapped_file&);
+
+		const char* data_ ;
+		size_t size_ ;
+#ifdef WIN32
+		HANDLE file_ ;
+		HANDLE mapping_ ;
+#endif
+	};
+
+	bool parse_digits(const char* p , int n , int* value)
+	{
+		int v = 0 ;
+		for (int i = 0; i < n; ++i)
+		{
+			if (p[i] < '0' || p[i] > '9')
+				return false ;
+			v = v * 10 + (p[i] - '0');
+		}
+		*value = v ;
+		return true ;
+	}
+
+	//公历日期到1970-01-01的天数
+	int64 days_from_civil(int y , int m , int d)
+	{
+		y -= m <= 2 ;
+		const int64 era = (y >= 0 ? y : y - 399) / 400 ;
+		const int64 yoe = y - era * 400 ;
+		const int64 doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1 ;
+		const int64 doe = yoe * 365 + yoe / 4 - yoe / 100 + doy ;
+		return era * 146097 + doe - 719468 ;
+	}
+
+	//解析行首的"YYYY-MM-DD HH:MM:SS",之后可以有'.'和1~9位小数。
+	//日志里是本地时间,只用来比较先后,不换算时区。返回时间戳占用的字节数,不是时间戳时返回0
+	size_t parse_time(const char* p , const char* end , int64* ns)
+	{
+		if (end - p < 19 || p[4] != '-' || p[7] != '-' || p[10] != ' ' || p[13] != ':' || p[16] != ':')
+			return 0 ;
+		int year , month , day , hour , minute , second ;
+		if (!parse_digits(p , 4 , &year) || !parse_digits(p + 5 , 2 , &month) || !parse_digits(p + 8 , 2 , &day)
+			|| !parse_digits(p + 11 , 2 , &hour) || !parse_digits(p + 14 , 2 , &minute) || !parse_digits(p + 17 , 2 , &second))
+			return 0 ;
+		if (month < 1 || month > 12 || day < 1 || day > 31)
+			return 0 ;
+
+		int64 value = (days_from_civil(year , month , day) * 86400 + hour * 3600 + minute * 60 + second) * kNsPerSec ;
+		size_t len = 19 ;
+		if (p + len < end && p[len] == '.')
+		{
+			int64 frac = 0 ;
+			int digits = 0 ;
+			++len ;
+			while (p + len < end && digits < 9 && p[len] >= '0' && p[len] <= '9')
+			{
+				frac = frac * 10 + (p[len] - '0');
+				++digits ;
+				++len ;
+			}
+			for (int i = digits; i < 9; ++i)
+				frac *= 10 ;
+			value += frac ;
+		}
+		*ns = value ;
+		return len ;
+	}
+
+	struct record
+	{
+		int64 ns ;
+		uint64 seq ;		//没有"#序号,"时为0
+		size_t input ;
+		const char* data ;
+		size_t len ;
+	};
+
+	//按(时间戳,序号,文件,位置)排序,std::priority_queue取最大的,所以反过来比较
+	struct record_greater
+	{
+		bool operator()(const record& a , const record& b) const
+		{
+			if (a.ns != b.ns)
+				return a.ns > b.ns ;
+			if (a.seq != b.seq)
+				return a.seq > b.seq ;
+			if (a.input != b.input)
+				return a.input > b.input ;
+			return a.data > b.data ;
+		}
+	};
+
+	typedef std::priority_queue<record , std::vector<record> , record_greater> record_heap ;
+
+	class log_input
+	{
+	public:
+		log_input(size_t index , size_t window)
+			: index_(index) , window_(window) , pos_(NULL) , end_(NULL) , cached_(NULL) , cached_ns_(0) , cached_len_(0)
+			, last_ns_(0) , stop_ns_(0) , has_stop_(false) , stop_(false) {}
+
+		bool open(const char* path) { return file_.open(path); }
+
+		//预读窗口中最早的一条
+		bool top(record* r) const
+		{
+			if (ordered_.empty() && late_.empty())
+				return false ;
+			if (late_.empty() || (!ordered_.empty() && !record_greater()(ordered_.front() , late_.top())))
+				*r = ordered_.front();
+			else
+				*r = late_.top();
+			return true ;
+		}
+
+		//去掉top返回的记录,再读一条补足窗口
+		void pop()
+		{
+			if (late_.empty() || (!ordered_.empty() && !record_greater()(ordered_.front() , late_.top())))
+				ordered_.pop_front();
+			else
+				late_.pop();
+			fill();
+		}
+
+		//按顺序到达的记录放进队列,比之前读到的早的才进堆,文件基本有序时每条都是O(1)
+		void fill()
+		{
+			record r ;
+			while (ordered_.size() + late_.size() < window_ && next(&r))
+			{
+				if (ordered_.empty() || !record_greater()(ordered_.back() , r))
+					ordered_.push_back(r);
+				else
+					late_.push(r);
+			}
+		}
+
+		//跳过开始时间之前的部分,读到结束时间之后的记录时停止。
+		//乱序不会超过slack_ns,所以从from - slack_ns开始读,读到to + slack_ns之后才停
+		void set_range(bool has_from , int64 from , bool has_to , int64 to , int64 slack_ns)
+		{
+			pos_ = file_.data();
+			end_ = pos_ + file_.size();
+			if (has_from)
+				pos_ = lower_bound(from - slack_ns);
+			stop_ = false ;
+			stop_ns_ = has_to ? to + slack_ns : 0 ;
+			has_stop_ = has_to ;
+		}
+
+	private:
+		//读出下一条记录,包括之后不以时间戳开头的行
+		bool next(record* r)
+		{
+			if (stop_ || pos_ >= end_)
+				return false ;
+			const char* begin = pos_ ;
+			int64 ns = cached_ns_ ;
+			size_t time_len = begin == cached_ ? cached_len_ : parse_time(begin , end_ , &ns);
+			const char* p = line_end(begin);
+			//下一条记录的时间戳留给下次用
+			while (p < end_)
+			{
+				cached_len_ = parse_time(p , end_ , &cached_ns_);
+				if (cached_len_)
+				{
+					cached_ = p ;
+					break ;
+				}
+				p = line_end(p);
+			}
+			pos_ = p ;
+			if (time_len && has_stop_ && ns > stop_ns_)
+			{
+				stop_ = true ;
+				return false ;
+			}
+
+			r->ns = time_len ? ns : last_ns_ ;
+			r->seq = time_len ? parse_seq(begin + time_len , p) : 0 ;
+			r->input = index_ ;
+			r->data = begin ;
+			r->len = p - begin ;
+			last_ns_ = r->ns ;
+			return true ;
+		}
+
+		const char* line_end(const char* p) const
+		{
+			const char* nl = static_cast<const char*>(memchr(p , '\n' , end_ - p));
+			return nl ? nl + 1 : end_ ;
+		}
+
+		//从p所在行的下一行开始找第一个以时间戳开头的行
+		const char* next_record(const char* p , int64* ns) const
+		{
+			if (p != file_.data())
+				p = line_end(p);
+			while (p < end_)
+			{
+				if (parse_time(p , end_ , ns))
+					return p ;
+				p = line_end(p);
+			}
+			return end_ ;
+		}
+
+		//第一条时间不早于ns的记录,文件大致按时间有序
+		const char* lower_bound(int64 ns) const
+		{
+			size_t lo = 0 ;
+			size_t hi = file_.size();
+			while (lo < hi)
+			{
+				size_t mid = lo + (hi - lo) / 2 ;
+				int64 t = 0 ;
+				const char* p = next_record(file_.data() + mid , &t);
+				if (p < end_ && t < ns)
+					lo = (p - file_.data()) + 1 ;
+				else
+					hi = mid ;
+			}
+			int64 t ;
+			return next_record(file_.data() + lo , &t);
+		}
+
+		//时间戳之后是",级别,",分片的文件接着是"#序号,"
+		static uint64 parse_seq(const char* p , const char* end)
+		{
+			if (end - p < 4 || p[0] != ',' || p[2] != ',' || p[3] != '#')
+				return 0 ;
+			uint64 seq = 0 ;
+			for (p += 4; p < end && *p >= '0' && *p <= '9'; ++p)
+				seq = seq * 10 + (*p - '0');
+			return seq ;
+		}
+
+		const size_t index_ ;
+		const size_t window_ ;
+		mapped_file file_ ;
+		const char* pos_ ;
+		const char* end_ ;
+		const char* cached_ ;		//已经解析过时间戳的下一条记录
+		int64 cached_ns_ ;
+		size_t cached_len_ ;
+		std::deque<record> ordered_ ;	//预读的记录中按顺序到达的
+		record_heap late_ ;				//预读的记录中比之前的早的
+		int64 last_ns_ ;
+		int64 stop_ns_ ;
+		bool has_stop_ ;
+		bool stop_ ;
+	};
+
+	void usage(const char* prog)
+	{
+		fprintf(stderr , "usage: %s [-s \"YYYY-MM-DD HH:MM:SS[.frac]\"] [-e \"YYYY-MM-DD HH:MM:SS[.frac]\"] [-w window] file...\n"
+			"  -s  only records at or after this time\n"
+			"  -e  only records at or before this time\n"
+			"  -w  records read ahead per file to absorb out-of-order records (default 65536)\n" , prog);
+	}
+
+	bool parse_time_arg(const char* arg , int64* ns)
+	{
+		const char* end = arg + strlen(arg);
+		size_t len = parse_time(arg , end , ns);
+		return len != 0 && arg + len == end ;
+	}
+}
+
+int main(int argc , char** argv)
+{
+	bool has_from = false , has_to = false ;
+	int64 from = 0 , to = 0 ;
+	size_t window = 65536 ;
+	int i = 1 ;
+	for (; i < argc && argv[i][0] == '-'; ++i)
+	{
+		if (i + 1 >= argc)
+		{
+			usage(argv[0]);
+			return 2 ;
+		}
+		if (strcmp(argv[i] , "-s") == 0 && parse_time_arg(argv[i + 1] , &from))
+			has_from = true ;
+		else if (strcmp(argv[i] , "-e") == 0 && parse_time_arg(argv[i + 1] , &to))
+		{
+			//精确到秒的结束时间包括这一秒内的全部记录
+			if (strchr(argv[i + 1] , '.') == NULL)
+				to += kNsPerSec - 1 ;
+			has_to = true ;
+		}
+		else if (strcmp(argv[i] , "-w") == 0 && atoi(argv[i + 1]) > 0)
+			window = static_cast<size_t>(atoi(argv[i + 1]));
+		else
+		{
+			usage(argv[0]);
+			return 2 ;
+		}
+		++i ;
+	}
+	if (i >= argc)
+	{
+		usage(argv[0]);
+		return 2 ;
+	}
+
+	std::vector<log_input*> inputs ;
+	int ret = 0 ;
+	for (; i < argc; ++i)
+	{
+		log_input* input = new log_input(inputs.size() , window) ;
+		if (!input->open(argv[i]))
+		{
+			fprintf(stderr , "%s: cannot open %s\n" , argv[0] , argv[i]);
+			delete input ;
+			ret = 1 ;
+			continue ;
+		}
+		//分片之间的乱序只有前端取时间戳到取序号之间的一小段,1秒足够
+		input->set_range(has_from , from , has_to , to , kNsPerSec);
+		inputs.push_back(input);
+	}
+
+	static char out_buffer[1 << 20] ;
+	setvbuf(stdout , out_buffer , _IOFBF , sizeof out_buffer);
+#ifdef WIN32
+	::_setmode(::_fileno(stdout) , _O_BINARY);
+#endif
+
+	//每个文件一项,是它预读窗口中最早的记录
+	record_heap heap ;
+	for (size_t n = 0; n < inputs.size(); ++n)
+	{
+		record r ;
+		inputs[n]->fill();
+		if (inputs[n]->top(&r))
+			heap.push(r);
+	}
+
+	while (!heap.empty())
+	{
+		record r = heap.top();
+		heap.pop();
+		if ((!has_from || r.ns >= from) && (!has_to || r.ns <= to))
+		{
+			if (fwrite(r.data , 1 , r.len , stdout) != r.len)
+			{
+				ret = 1 ;
+				break ;
+			}
+			//进程崩溃时文件最后一条可能没有换行
+			if (r.data[r.len - 1] != '\n')
+				putc('\n' , stdout);
+		}
+		record next ;
+		inputs[r.input]->pop();
+		if (inputs[r.input]->top(&next))
+			heap.push(next);
+	}
+	fflush(stdout);
+
+	for (size_t n = 0; n < inputs.size(); ++n)
+		delete inputs[n];
+	return ret ;
+}
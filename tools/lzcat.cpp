@@ -0,0 +1,47 @@
+//把.lz日志解压到标准输出,滚动后压缩的和写入时压缩的文件都可以:
+//	lzcat app.20261017-120000-3.log.lz | grep ERR
+//文件损坏、最后一块不完整或没有结尾标记时,先输出之前能解出的内容,再在stderr提示并返回1。
+//还在写或进程崩溃后没有关闭的写入时压缩的文件没有结尾标记,用-p读到最后一个完整的块:
+//	lzcat -p applog/app.20261017-120000-3.log.lz | tail
+#include "stdafx.h"
+#include <stdio.h>
+#include <string.h>
+#include "log_lz.h"
+#ifdef WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+int main(int argc , char** argv)
+{
+	bool allow_unterminated = false ;
+	int first = 1 ;
+	if (argc > 1 && strcmp(argv[1] , "-p") == 0)
+	{
+		allow_unterminated = true ;
+		++first ;
+	}
+	if (first >= argc)
+	{
+		fprintf(stderr, "usage: %s [-p] file.lz...\n", argv[0]);
+		fprintf(stderr, "  -p  accept a file without the end marker (still being written or not closed)\n");
+		return 2 ;
+	}
+#ifdef WIN32
+	::_setmode(::_fileno(stdout) , _O_BINARY);
+#endif
+
+	int ret = 0 ;
+	for (int i = first; i < argc; ++i)
+	{
+		if (!fst_log_file::lz::decompress_file(argv[i] , stdout , allow_unterminated))
+		{
+			fflush(stdout);
+			fprintf(stderr, "%s: %s is truncated or corrupt%s\n", argv[0], argv[i],
+				allow_unterminated ? "" : " (use -p for a file that is still open)");
+			ret = 1 ;
+		}
+	}
+	fflush(stdout);
+	return ret ;
+}